@@ -0,0 +1,93 @@
+/* layout_bench — time the tiling geometry without an X server
+ *
+ * runs layout_arrange() for every layout in layouts[] over 1..1000 synthetic
+ * clients with gaps, borders and dock struts, and reports ns per layout
+ * pass plus heap allocations per pass once the scratch has warmed up.
+ * bsp keeps its tree in a LayoutState across passes, as a workspace does.
+ * the last column counts windows that leave the screen or drop below the
+ * minimum size; bsp must keep it at 0 however deep its tree gets.
+ *
+ * build/run: make bench
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "layout.h"
+
+/* allocation counting through ld --wrap (see Makefile) */
+static unsigned long allocs;
+
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t sz);
+void *__real_realloc(void *p, size_t n);
+
+void *__wrap_malloc(size_t n) { ++allocs; return __real_malloc(n); }
+void *__wrap_calloc(size_t n, size_t sz) { ++allocs; return __real_calloc(n, sz); }
+void *__wrap_realloc(void *p, size_t n) { ++allocs; return __real_realloc(p, n); }
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static volatile int sink;
+
+/* windows (border included) that leave the screen or are smaller than the minimum */
+static int outside(const LayoutParams *p, const Rect *r, int n) {
+    int bad = 0;
+    for (int i = 0; i < n; ++i) {
+        int w = r[i].w + 2 * p->border, h = r[i].h + 2 * p->border;
+        if (r[i].x < p->screen_x || r[i].y < p->screen_y ||
+            r[i].x + w > p->screen_x + p->screen_w || r[i].y + h > p->screen_y + p->screen_h ||
+            r[i].w < MIN_WIN_W || r[i].h < MIN_WIN_H)
+            ++bad;
+    }
+    return bad;
+}
+
+static void run(int layout, const LayoutParams *p, int n) {
+    /* warm up: sizes the scratch buffer and grows any layout state */
+    LayoutState st = { 0 };
+    Rect *r = layout_rects(n);
+    if (!r) { fprintf(stderr, "out of memory\n"); exit(EXIT_FAILURE); }
+    layout_arrange(layout, p, &st, n, r);
+
+    long iters = 2000000L / n;
+    if (iters < 200) iters = 200;
+
+    unsigned long a0 = allocs;
+    double t0 = now_ns();
+    for (long i = 0; i < iters; ++i) {
+        r = layout_rects(n);
+        layout_arrange(layout, p, &st, n, r);
+        sink += r[n - 1].w;
+    }
+    double t1 = now_ns();
+
+    int bad = outside(p, r, n);
+    free(st.nodes);
+
+    printf("%-8s n=%-5d %12.1f ns/layout %8.3f allocs/layout %5d outside\n",
+           layouts[layout].name, n, (t1 - t0) / iters, (double)(allocs - a0) / iters, bad);
+}
+
+int main(void) {
+    static const int sizes[] = { 1, 2, 3, 5, 10, 20, 50, 64, 100, 200, 500, 1000 };
+    LayoutParams p = {
+        .screen_w = 3840, .screen_h = 2160,
+        .reserve_top = 32, .reserve_bottom = 0, .reserve_left = 0, .reserve_right = 48,
+        .gap_outer = 8, .gap_inner = 6,
+        .border = 2,
+        .master_factor = 60,
+        .nmaster = 1,
+    };
+
+    for (int l = 0; l < LAYOUT_COUNT; ++l)
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+            run(l, &p, sizes[i]);
+    return 0;
+}
@@ -0,0 +1,294 @@
+/* replay_bench — count X traffic per scenario without an X server
+ *
+ * builds wm.c against the xstub fake Xlib, then replays synthetic event
+ * traces through the same handlers run_loop() uses and reports how many
+ * protocol requests, round trips and output flushes each one cost.
+ * round trips are what users feel as latency, so that is the column to
+ * watch when touching manage(), switch_workspace() or update_borders().
+ *
+ * each scenario runs in a forked child so it starts from a fresh wm.
+ *
+ * build/run: make bench    (./bench/replay_bench -v for per-request counts)
+ */
+#define main wm_main
+#include "wm.c"
+#undef main
+
+#include <sys/wait.h>
+
+#include "bench/xstub.h"
+
+static int verbose;
+
+/* scenario helpers */
+static Window *spawn_windows(int n, int mapped) {
+    Window *w = calloc(n, sizeof(Window));
+    if (!w) die("out of memory");
+    for (int i = 0; i < n; ++i)
+        w[i] = xstub_create_window(40 + i % 50, 30 + i % 40, 640, 480, mapped);
+    return w;
+}
+
+/* map n windows onto one workspace, one loop iteration for the lot */
+static Window *populate(int ws, int n) {
+    switch_workspace(ws);
+    flush_pending();
+    Window *w = spawn_windows(n, 0);
+    for (int i = 0; i < n; ++i) xstub_map_request(w[i]);
+    process_events();
+    return w;
+}
+
+static Window add_dock(int height) {
+    Window d = xstub_create_window(0, 0, DisplayWidth(dpy, screen_num), height, 0);
+    Atom dock = xstub_atom("_NET_WM_WINDOW_TYPE_DOCK");
+    long strut[12] = { 0, 0, height, 0, 0, 0, 0, 0, 0, DisplayWidth(dpy, screen_num) - 1, 0, 0 };
+    xstub_set_property(d, NET_WM_WINDOW_TYPE, XA_ATOM, 32, &dock, 1);
+    xstub_set_property(d, NET_WM_STRUT_PARTIAL, XA_CARDINAL, 32, strut, 12);
+    xstub_map_request(d);
+    process_events();
+    return d;
+}
+
+/* one event per loop iteration, as from a user at the keyboard */
+static int replay_each(void) {
+    int n = 0;
+    while (xstub_queued()) {
+        XEvent ev;
+        XNextEvent(dpy, &ev);
+        handle_event(&ev);
+        flush_pending();
+        ++n;
+    }
+    return n;
+}
+
+/* scenarios; each sets up its world, resets the counters, then replays */
+static void sc_restore(void) {
+    Window *w = spawn_windows(200, 0);
+    xstub_reset_counts();
+    for (int i = 0; i < 200; ++i) xstub_map_request(w[i]);
+    process_events();
+    free(w);
+}
+
+static void sc_adopt(void) {
+    free(spawn_windows(200, 1));
+    xstub_reset_counts();
+    /* startup path from main() */
+    scan_existing_windows();
+    for (int i = 0; i < MAX_WORKSPACES; ++i) queue_arrange(i);
+    queue_status();
+    flush_pending();
+}
+
+static void sc_swap_storm(void) {
+    free(populate(0, 12));
+    xstub_reset_counts();
+    for (int i = 0; i < 500; ++i)
+        xstub_key_press(i & 1 ? XK_l : XK_h, MOD_MAIN | ShiftMask);
+    replay_each();
+}
+
+static void sc_workspace_thrash(void) {
+    for (int ws = 0; ws < MAX_WORKSPACES; ++ws) free(populate(ws, 8));
+    xstub_reset_counts();
+    for (int i = 0; i < 100; ++i)
+        for (int ws = 0; ws < MAX_WORKSPACES; ++ws) xstub_key_press(XK_1 + ws, MOD_MAIN);
+    replay_each();
+}
+
+static void sc_dock_struts(void) {
+    Window dock = add_dock(24);
+    for (int ws = 0; ws < 3; ++ws) free(populate(ws, 6));
+    switch_workspace(0);
+    flush_pending();
+    xstub_reset_counts();
+    for (int i = 0; i < 200; ++i) {
+        long strut[12] = { 0, 0, 24 + i % 8, 0, 0, 0, 0, 0, 0, DisplayWidth(dpy, screen_num) - 1, 0, 0 };
+        xstub_set_property(dock, NET_WM_STRUT_PARTIAL, XA_CARDINAL, 32, strut, 12);
+        xstub_property_notify(dock, NET_WM_STRUT_PARTIAL);
+        replay_each();
+    }
+}
+
+static void sc_motion_sweep(void) {
+    Window *w = populate(0, 16);
+    xstub_reset_counts();
+    /* pointer crossing the tiles, ten motion events per read */
+    for (int i = 0; i < 2000; ++i) {
+        Client *c = find_client(w[(i / 25) % 16]);
+        xstub_motion(c ? c->x + 5 : 0, c ? c->y + 5 : 0, c ? c->win : None);
+        if (i % 10 == 9) process_events();
+    }
+    free(w);
+}
+
+static void sc_drag(void) {
+    Window *w = populate(0, 4);
+    set_workspace_mode(0, MODE_FLOATING);
+    flush_pending();
+    Client *c = find_client(w[0]);
+    xstub_reset_counts();
+    /* super+drag: a 1000 Hz mouse delivers far more motion than frames */
+    XEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = ButtonPress;
+    ev.xbutton.window = root;
+    ev.xbutton.subwindow = c->win;
+    ev.xbutton.button = Button1;
+    ev.xbutton.state = MOD_MAIN;
+    ev.xbutton.x_root = c->x + 10;
+    ev.xbutton.y_root = c->y + 10;
+    xstub_push_event(&ev);
+    for (int i = 1; i <= 1000; ++i) xstub_motion(c->x + 10 + i, c->y + 10 + i / 2, None);
+    ev.type = ButtonRelease;
+    ev.xbutton.x_root = c->x + 1010;
+    ev.xbutton.y_root = c->y + 510;
+    xstub_push_event(&ev);
+    replay_each();
+    free(w);
+}
+
+/* super held, tab pressed 49 times through 50 windows, then super let go:
+ * steps only move focus and the border, one raise at the end */
+static void sc_alt_tab(void) {
+    free(populate(0, 50));
+    xstub_reset_counts();
+    for (int i = 0; i < 49; ++i) xstub_key_press(XK_Tab, MOD_MAIN);
+    xstub_key_release(XK_Super_L, MOD_MAIN);
+    replay_each();
+}
+
+/* windows opening one at a time on a bsp workspace: each one splits the
+ * focused tile, so only that tile and the newcomer get configured */
+static void sc_bsp_map(void) {
+    set_workspace_layout(0, LAYOUT_BSP);
+    free(populate(0, 12));
+    Window *w = spawn_windows(20, 0);
+    xstub_reset_counts();
+    for (int i = 0; i < 20; ++i) {
+        xstub_map_request(w[i]);
+        replay_each();
+    }
+    free(w);
+}
+
+/* 64 windows opened one by one on bsp, each splitting the newest tile: the
+ * deepest tiles must stop splitting and still land on screen */
+static void sc_bsp_deep(void) {
+    set_workspace_layout(0, LAYOUT_BSP);
+    switch_workspace(0);
+    flush_pending();
+    Window *w = spawn_windows(64, 0);
+    xstub_reset_counts();
+    for (int i = 0; i < 64; ++i) {
+        xstub_map_request(w[i]);
+        replay_each();
+    }
+    int sw = DisplayWidth(dpy, screen_num), sh = DisplayHeight(dpy, screen_num);
+    for (int i = 0; i < 64; ++i) {
+        Client *c = find_client(w[i]);
+        if (!c || c->x < 0 || c->y < 0 || c->x + (int)c->w > sw || c->y + (int)c->h > sh)
+            die("bsp tile off screen");
+    }
+    free(w);
+}
+
+/* a script driving the control socket: every command arrives in one read,
+ * so the whole batch costs one layout pass and one flush */
+static void sc_ipc_batch(void) {
+    free(populate(0, 12));
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&ipc_addr, sizeof(ipc_addr)) < 0) die("cannot reach control socket");
+    char script[IPC_LINE_MAX * 64];
+    int len = 0;
+    for (int i = 0; i < 50; ++i)
+        len += snprintf(script + len, sizeof(script) - len, "swap %s\nlayout 1 %s\n",
+                        i & 1 ? "left" : "right", i & 1 ? "master" : "dwindle");
+    if (write(fd, script, len) != len) die("short write");
+    ipc_accept();
+    xstub_reset_counts();
+    for (int i = 0; i < ipc_nclients; ++i) ipc_read(&ipc_clients[i]);
+    process_events();
+    close(fd);
+}
+
+static const struct {
+    const char *name;
+    void (*run)(void);
+} scenarios[] = {
+    { "restore-200",   sc_restore },
+    { "adopt-200",     sc_adopt },
+    { "swap-storm",    sc_swap_storm },
+    { "ws-thrash",     sc_workspace_thrash },
+    { "dock-struts",   sc_dock_struts },
+    { "motion-sweep",  sc_motion_sweep },
+    { "drag-move",     sc_drag },
+    { "alt-tab",       sc_alt_tab },
+    { "bsp-map",       sc_bsp_map },
+    { "bsp-deep",      sc_bsp_deep },
+    { "ipc-batch",     sc_ipc_batch },
+};
+
+static void run_scenario(int i) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) die("fork failed");
+    if (pid == 0) {
+        dpy = XOpenDisplay(NULL);
+        setup();
+        for (int ws = 0; ws < MAX_WORKSPACES; ++ws) tag_mode[ws] = MODE_TILING;
+        flush_pending();
+        scenarios[i].run();
+        XStubCounts n = xstub_counts();
+        printf("%-14s %8lu %10lu %10lu %9lu %10.2f\n", scenarios[i].name,
+               n.events, n.requests, n.round_trips, n.flushes,
+               n.events ? (double)n.requests / n.events : 0.0);
+        if (verbose) xstub_print_breakdown(stdout);
+        fflush(stdout);
+        _exit(EXIT_SUCCESS);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+        fprintf(stderr, "%s: failed\n", scenarios[i].name);
+}
+
+static int selected(int argc, char **argv, const char *name) {
+    int any = 0;
+    for (int a = 1; a < argc; ++a) {
+        if (argv[a][0] == '-') continue;
+        any = 1;
+        if (strcmp(argv[a], name) == 0) return 1;
+    }
+    return !any;
+}
+
+static void remove_home(const char *home) {
+    static const char *files[] = { "status", "focused.workspace", "occupied.workspace", "ctl" };
+    char path[PATH_MAX];
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i) {
+        snprintf(path, sizeof(path), "%s/.wm/%s", home, files[i]);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/.wm", home);
+    rmdir(path);
+    rmdir(home);
+}
+
+int main(int argc, char **argv) {
+    /* keep the status export out of the real ~/.wm */
+    char home[] = "/tmp/replay_bench.XXXXXX";
+    if (!mkdtemp(home)) die("mkdtemp failed");
+    setenv("HOME", home, 1);
+
+    for (int a = 1; a < argc; ++a) if (strcmp(argv[a], "-v") == 0) verbose = 1;
+
+    printf("%-14s %8s %10s %10s %9s %10s\n", "scenario", "events", "requests", "roundtrips", "flushes", "req/event");
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i)
+        if (selected(argc, argv, scenarios[i].name)) run_scenario((int)i);
+
+    remove_home(home);
+    return 0;
+}
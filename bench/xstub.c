@@ -0,0 +1,853 @@
+/* xstub — see xstub.h
+ *
+ * costs follow libX11: replies block (one round trip each, and the wait
+ * flushes whatever was buffered), atoms and the keyboard mapping are cached
+ * client side after the first fetch, XGetWindowAttributes is two requests
+ * waited on in turn, and XFlush only writes when something is buffered.
+ * xcb requests get a sequence number and only block when their reply is
+ * collected, and one wait answers everything sent before it.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xatom.h>
+#include <X11/keysym.h>
+#include <X11/Xutil.h>
+#include <X11/Xlib-xcb.h>
+#include <X11/extensions/sync.h>
+#include <xcb/xcb.h>
+
+#include "xstub.h"
+
+#define SCREEN_W 1920
+#define SCREEN_H 1080
+#define ROOT_ID  0x100
+
+enum {
+    R_GetWindowAttributes, R_GetGeometry, R_GetProperty, R_ChangeProperty,
+    R_QueryTree, R_InternAtom, R_GetKeyboardMapping, R_AllocNamedColor,
+    R_ConfigureWindow, R_ChangeWindowAttributes, R_MapWindow, R_UnmapWindow,
+    R_SetInputFocus, R_GrabKey, R_GrabButton, R_GrabPointer, R_UngrabPointer,
+    R_UngrabKey, R_UngrabButton, R_GrabKeyboard, R_UngrabKeyboard, R_QueryPointer, R_SendEvent, R_OpenFont, R_CreateGlyphCursor, R_CloseFont, R_FreeCursor,
+    R_GetInputFocus, R_GrabServer, R_UngrabServer, R_CreateGC, R_PolyRectangle, R_QueryExtension, R_COUNT
+};
+
+static const char *req_names[R_COUNT] = {
+    "GetWindowAttributes", "GetGeometry", "GetProperty", "ChangeProperty",
+    "QueryTree", "InternAtom", "GetKeyboardMapping", "AllocNamedColor",
+    "ConfigureWindow", "ChangeWindowAttributes", "MapWindow", "UnmapWindow",
+    "SetInputFocus", "GrabKey", "GrabButton", "GrabPointer", "UngrabPointer",
+    "UngrabKey", "UngrabButton", "GrabKeyboard", "UngrabKeyboard", "QueryPointer", "SendEvent", "OpenFont", "CreateGlyphCursor", "CloseFont", "FreeCursor",
+    "GetInputFocus", "GrabServer", "UngrabServer", "CreateGC", "PolyRectangle", "QueryExtension"
+};
+
+typedef struct {
+    Atom atom, type;
+    int format, n;
+    unsigned char *data;
+} Prop;
+
+typedef struct {
+    Window id;
+    int x, y;
+    unsigned int w, h, bw;
+    int mapped;
+    long mask;
+    Prop *props;
+    int nprops;
+} Win;
+
+static Win *wins;
+static int nwins;
+static Window *order; /* stacking order of the root's children, bottom first */
+
+static char **atom_names;  /* index + 1 + XA_LAST_PREDEFINED == atom */
+static unsigned char *atom_cached;
+static int natoms;
+
+static KeySym keysyms[256]; /* keycode -> keysym, filled on demand */
+static unsigned int held_mods; /* as of the last key event handed out */
+static int keymap_cached;
+
+static XEvent *queue;
+static int qhead, qlen, qcap;
+
+static XStubCounts counts;
+static unsigned long per_req[R_COUNT];
+static unsigned long buffered; /* requests not yet written */
+static unsigned long seq;      /* last request issued */
+static unsigned long answered; /* last request whose reply has arrived */
+
+/* outstanding xcb queries by sequence number */
+#define XCB_RING 4096
+static struct {
+    Window win;
+    Atom atom;
+    long len;
+} xcb_queries[XCB_RING];
+
+static Screen screen;
+static __typeof__(*(_XPrivDisplay)0) display;
+
+/* --- accounting --- */
+static void request(int kind) {
+    ++seq;
+    ++counts.requests;
+    ++per_req[kind];
+    ++buffered;
+}
+
+static void round_trip(int kind) {
+    request(kind);
+    ++counts.round_trips;
+    ++counts.flushes; /* waiting on a reply writes the buffer first */
+    buffered = 0;
+    answered = seq;
+}
+
+/* block for the reply to request s, unless an earlier wait covered it */
+static void await_reply(unsigned int s) {
+    if (s <= answered) return;
+    ++counts.round_trips;
+    ++counts.flushes;
+    buffered = 0;
+    answered = seq;
+}
+
+static unsigned int xcb_query(int kind, Window w, Atom atom, long len) {
+    request(kind);
+    xcb_queries[seq % XCB_RING].win = w;
+    xcb_queries[seq % XCB_RING].atom = atom;
+    xcb_queries[seq % XCB_RING].len = len;
+    return (unsigned int)seq;
+}
+
+static void *xcb_error(xcb_generic_error_t **e, int code) {
+    if (e) {
+        *e = calloc(1, sizeof(**e));
+        if (*e) (*e)->error_code = code;
+    }
+    return NULL;
+}
+
+void xstub_reset_counts(void) {
+    memset(&counts, 0, sizeof(counts));
+    memset(per_req, 0, sizeof(per_req));
+}
+
+XStubCounts xstub_counts(void) { return counts; }
+
+void xstub_print_breakdown(FILE *out) {
+    for (int i = 0; i < R_COUNT; ++i)
+        if (per_req[i]) fprintf(out, "    %-24s %lu\n", req_names[i], per_req[i]);
+}
+
+/* --- windows / atoms --- */
+static Win *win_get(Window id) {
+    for (int i = 0; i < nwins; ++i)
+        if (wins[i].id == id) return &wins[i];
+    return NULL;
+}
+
+static Prop *prop_get(Win *w, Atom a) {
+    for (int i = 0; i < w->nprops; ++i)
+        if (w->props[i].atom == a) return &w->props[i];
+    return NULL;
+}
+
+Window xstub_create_window(int x, int y, unsigned int w, unsigned int h, int mapped) {
+    Win *nw = realloc(wins, (nwins + 1) * sizeof(Win));
+    if (!nw) abort();
+    wins = nw;
+    Win *v = &wins[nwins];
+    memset(v, 0, sizeof(*v));
+    v->id = 0x400000 + (Window)nwins * 0x10;
+    v->x = x; v->y = y; v->w = w; v->h = h;
+    v->mapped = mapped;
+    ++nwins;
+    Window *no = realloc(order, nwins * sizeof(Window));
+    if (!no) abort();
+    order = no;
+    order[nwins - 1] = v->id; /* created on top */
+    return v->id;
+}
+
+void xstub_set_property(Window id, Atom atom, Atom type, int format, const void *data, int n) {
+    Win *w = win_get(id);
+    if (!w) return;
+    Prop *p = prop_get(w, atom);
+    if (!p) {
+        Prop *np = realloc(w->props, (w->nprops + 1) * sizeof(Prop));
+        if (!np) abort();
+        w->props = np;
+        p = &w->props[w->nprops++];
+        p->atom = atom;
+        p->data = NULL;
+    }
+    size_t unit = format == 32 ? sizeof(long) : (size_t)format / 8;
+    free(p->data);
+    p->data = malloc(unit * (n ? n : 1));
+    if (!p->data) abort();
+    memcpy(p->data, data, unit * n);
+    p->type = type; p->format = format; p->n = n;
+}
+
+static Atom atom_lookup(const char *name, int *fresh) {
+    for (int i = 0; i < natoms; ++i)
+        if (strcmp(atom_names[i], name) == 0) {
+            *fresh = !atom_cached[i];
+            atom_cached[i] = 1;
+            return (Atom)(XA_LAST_PREDEFINED + 1 + i);
+        }
+    char **nn = realloc(atom_names, (natoms + 1) * sizeof(char *));
+    unsigned char *nc = realloc(atom_cached, natoms + 1);
+    if (!nn || !nc) abort();
+    atom_names = nn; atom_cached = nc;
+    atom_names[natoms] = strdup(name);
+    atom_cached[natoms] = 1;
+    *fresh = 1;
+    return (Atom)(XA_LAST_PREDEFINED + 1 + natoms++);
+}
+
+Atom xstub_atom(const char *name) {
+    int fresh;
+    Atom a = atom_lookup(name, &fresh);
+    if (fresh) atom_cached[a - XA_LAST_PREDEFINED - 1] = 0; /* the wm still pays for its own intern */
+    return a;
+}
+
+static void keymap_fetch(void) {
+    if (keymap_cached) return;
+    keymap_cached = 1;
+    round_trip(R_GetKeyboardMapping);
+}
+
+/* --- stacking --- */
+static int order_index(Window id) {
+    for (int i = 0; i < nwins; ++i)
+        if (order[i] == id) return i;
+    return -1;
+}
+
+/* move id to sit directly above (or below) sibling; None == top (bottom) */
+static void order_move(Window id, Window sibling, int above) {
+    int i = order_index(id);
+    if (i < 0) return;
+    memmove(order + i, order + i + 1, (nwins - i - 1) * sizeof(Window));
+    order[nwins - 1] = None;    /* id is out of the list while we search */
+    int j = sibling != None ? order_index(sibling) : -1;
+    int at = j < 0 ? (above ? nwins - 1 : 0) : (above ? j + 1 : j);
+    memmove(order + at + 1, order + at, (nwins - 1 - at) * sizeof(Window));
+    order[at] = id;
+}
+
+const Window *xstub_stacking(int *n) {
+    *n = nwins;
+    return order;
+}
+
+/* --- events --- */
+void xstub_push_event(const XEvent *ev) {
+    if (qhead + qlen == qcap) {
+        if (qhead) {
+            memmove(queue, queue + qhead, qlen * sizeof(XEvent));
+            qhead = 0;
+        } else {
+            int ncap = qcap ? qcap * 2 : 256;
+            XEvent *nq = realloc(queue, ncap * sizeof(XEvent));
+            if (!nq) abort();
+            queue = nq; qcap = ncap;
+        }
+    }
+    queue[qhead + qlen++] = *ev;
+    display.qlen = qlen;
+}
+
+static void pop_at(int i, XEvent *out) {
+    *out = queue[qhead + i];
+    memmove(queue + qhead + i, queue + qhead + i + 1, (qlen - i - 1) * sizeof(XEvent));
+    --qlen;
+    if (!qlen) qhead = 0;
+    display.qlen = qlen;
+    ++counts.events;
+}
+
+int xstub_queued(void) { return qlen; }
+
+void xstub_map_request(Window w) {
+    XEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = MapRequest;
+    ev.xmaprequest.parent = ROOT_ID;
+    ev.xmaprequest.window = w;
+    xstub_push_event(&ev);
+}
+
+void xstub_key_press(KeySym ks, unsigned int state) {
+    XEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = KeyPress;
+    ev.xkey.window = ROOT_ID;
+    ev.xkey.root = ROOT_ID;
+    ev.xkey.state = state;
+    ev.xkey.keycode = XKeysymToKeycode((Display *)&display, ks);
+    xstub_push_event(&ev);
+}
+
+void xstub_key_release(KeySym ks, unsigned int state) {
+    XEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = KeyRelease;
+    ev.xkey.window = ROOT_ID;
+    ev.xkey.root = ROOT_ID;
+    ev.xkey.state = state;
+    ev.xkey.keycode = XKeysymToKeycode((Display *)&display, ks);
+    xstub_push_event(&ev);
+}
+
+void xstub_motion(int x, int y, Window subwindow) {
+    XEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = MotionNotify;
+    ev.xmotion.window = ROOT_ID;
+    ev.xmotion.root = ROOT_ID;
+    ev.xmotion.subwindow = subwindow;
+    ev.xmotion.x = ev.xmotion.x_root = x;
+    ev.xmotion.y = ev.xmotion.y_root = y;
+    xstub_push_event(&ev);
+}
+
+void xstub_property_notify(Window w, Atom atom) {
+    XEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = PropertyNotify;
+    ev.xproperty.window = w;
+    ev.xproperty.atom = atom;
+    ev.xproperty.state = PropertyNewValue;
+    xstub_push_event(&ev);
+}
+
+/* --- Xlib --- */
+Display *XOpenDisplay(_Xconst char *name) {
+    (void)name;
+    memset(&screen, 0, sizeof(screen));
+    screen.display = (Display *)&display;
+    screen.root = ROOT_ID;
+    screen.width = SCREEN_W;
+    screen.height = SCREEN_H;
+    screen.black_pixel = 0;
+    screen.white_pixel = 0xffffff;
+    screen.cmap = 0x20;
+    display.fd = -1;
+    display.screens = &screen;
+    display.nscreens = 1;
+    display.default_screen = 0;
+    return (Display *)&display;
+}
+
+int XCloseDisplay(Display *d) { (void)d; return 0; }
+
+XErrorHandler XSetErrorHandler(XErrorHandler h) { (void)h; return NULL; }
+
+int XGetErrorText(Display *d, int code, char *buf, int len) {
+    (void)d;
+    snprintf(buf, len, "error %d", code);
+    return 0;
+}
+
+int XFree(void *data) { free(data); return 1; }
+
+int XFlush(Display *d) {
+    (void)d;
+    if (buffered) { ++counts.flushes; buffered = 0; }
+    return 1;
+}
+
+unsigned long XNextRequest(Display *d) { (void)d; return seq + 1; }
+
+int XSync(Display *d, Bool discard) {
+    (void)d; (void)discard;
+    round_trip(R_GetInputFocus);
+    return 1;
+}
+
+Atom XInternAtom(Display *d, _Xconst char *name, Bool only_if_exists) {
+    (void)d; (void)only_if_exists;
+    int fresh;
+    Atom a = atom_lookup(name, &fresh);
+    if (fresh) round_trip(R_InternAtom);
+    return a;
+}
+
+Status XAllocNamedColor(Display *d, Colormap cmap, _Xconst char *name, XColor *scr, XColor *exact) {
+    (void)d; (void)cmap;
+    round_trip(R_AllocNamedColor);
+    memset(scr, 0, sizeof(*scr));
+    scr->pixel = (unsigned long)strlen(name);
+    *exact = *scr;
+    return 1;
+}
+
+KeyCode XKeysymToKeycode(Display *d, KeySym ks) {
+    (void)d;
+    keymap_fetch();
+    for (int i = 8; i < 256; ++i) {
+        if (keysyms[i] == ks) return (KeyCode)i;
+        if (!keysyms[i]) { keysyms[i] = ks; return (KeyCode)i; }
+    }
+    return 0;
+}
+
+int XRefreshKeyboardMapping(XMappingEvent *ev) {
+    (void)ev;
+    keymap_cached = 0; /* refetched on the next lookup, like Xlib */
+    return 0;
+}
+
+/* client-side in Xlib too; enough names for a config file */
+KeySym XStringToKeysym(const char *name) {
+    static const struct { const char *name; KeySym ks; } names[] = {
+        { "Return", XK_Return }, { "Tab", XK_Tab }, { "space", XK_space }, { "Escape", XK_Escape },
+        { "Left", XK_Left }, { "Right", XK_Right }, { "Up", XK_Up }, { "Down", XK_Down },
+        { "minus", XK_minus }, { "equal", XK_equal }, { "comma", XK_comma }, { "period", XK_period },
+        { "bracketleft", XK_bracketleft }, { "bracketright", XK_bracketright },
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+        if (strcmp(names[i].name, name) == 0) return names[i].ks;
+    /* latin-1 keysyms are their own character */
+    if (name[0] && !name[1] && (unsigned char)name[0] > 0x20 && (unsigned char)name[0] < 0x7f) return (KeySym)name[0];
+    return NoSymbol;
+}
+
+KeySym XLookupKeysym(XKeyEvent *ke, int index) {
+    (void)index;
+    keymap_fetch();
+    return ke->keycode < 256 ? keysyms[ke->keycode] : NoSymbol;
+}
+
+Cursor XCreateFontCursor(Display *d, unsigned int shape) {
+    (void)d;
+    request(R_OpenFont);
+    request(R_CreateGlyphCursor);
+    request(R_CloseFont);
+    return 0x300 + shape;
+}
+
+int XFreeCursor(Display *d, Cursor c) { (void)d; (void)c; request(R_FreeCursor); return 1; }
+
+int XGrabKey(Display *d, int kc, unsigned int mods, Window w, Bool oe, int pm, int km) {
+    (void)d; (void)kc; (void)mods; (void)w; (void)oe; (void)pm; (void)km;
+    request(R_GrabKey);
+    return 1;
+}
+
+int XGrabKeyboard(Display *d, Window w, Bool oe, int pm, int km, Time t) {
+    (void)d; (void)w; (void)oe; (void)pm; (void)km; (void)t;
+    round_trip(R_GrabKeyboard);
+    return GrabSuccess;
+}
+
+int XUngrabKeyboard(Display *d, Time t) { (void)d; (void)t; request(R_UngrabKeyboard); return 1; }
+
+Bool XQueryPointer(Display *d, Window w, Window *root_ret, Window *child, int *rx, int *ry,
+                   int *wx, int *wy, unsigned int *mask) {
+    (void)d; (void)w;
+    round_trip(R_QueryPointer);
+    *root_ret = ROOT_ID;
+    *child = None;
+    *rx = *ry = *wx = *wy = 0;
+    *mask = held_mods;
+    return True;
+}
+
+int XUngrabKey(Display *d, int kc, unsigned int mods, Window w) {
+    (void)d; (void)kc; (void)mods; (void)w;
+    request(R_UngrabKey);
+    return 1;
+}
+
+int XUngrabButton(Display *d, unsigned int b, unsigned int mods, Window w) {
+    (void)d; (void)b; (void)mods; (void)w;
+    request(R_UngrabButton);
+    return 1;
+}
+
+int XGrabButton(Display *d, unsigned int b, unsigned int mods, Window w, Bool oe, unsigned int mask,
+                int pm, int km, Window confine, Cursor c) {
+    (void)d; (void)b; (void)mods; (void)w; (void)oe; (void)mask; (void)pm; (void)km; (void)confine; (void)c;
+    request(R_GrabButton);
+    return 1;
+}
+
+int XGrabPointer(Display *d, Window w, Bool oe, unsigned int mask, int pm, int km,
+                 Window confine, Cursor c, Time t) {
+    (void)d; (void)w; (void)oe; (void)mask; (void)pm; (void)km; (void)confine; (void)c; (void)t;
+    round_trip(R_GrabPointer);
+    return GrabSuccess;
+}
+
+int XUngrabPointer(Display *d, Time t) { (void)d; (void)t; request(R_UngrabPointer); return 1; }
+
+int XSelectInput(Display *d, Window id, long mask) {
+    (void)d;
+    Win *w = win_get(id);
+    if (w) w->mask = mask;
+    request(R_ChangeWindowAttributes);
+    return 1;
+}
+
+Status XGetWindowAttributes(Display *d, Window id, XWindowAttributes *wa) {
+    (void)d;
+    round_trip(R_GetWindowAttributes);
+    round_trip(R_GetGeometry);
+    memset(wa, 0, sizeof(*wa));
+    wa->root = ROOT_ID;
+    wa->screen = &screen;
+    if (id == ROOT_ID) {
+        wa->width = SCREEN_W; wa->height = SCREEN_H;
+        wa->map_state = IsViewable;
+        return 1;
+    }
+    Win *w = win_get(id);
+    if (!w) return 0;
+    wa->x = w->x; wa->y = w->y;
+    wa->width = (int)w->w; wa->height = (int)w->h;
+    wa->border_width = (int)w->bw;
+    wa->map_state = w->mapped ? IsViewable : IsUnmapped;
+    wa->your_event_mask = w->mask;
+    return 1;
+}
+
+int XGetWindowProperty(Display *d, Window id, Atom atom, long off, long len, Bool del, Atom req_type,
+                       Atom *type_ret, int *format_ret, unsigned long *n_ret,
+                       unsigned long *after_ret, unsigned char **prop_ret) {
+    (void)d; (void)del; (void)req_type;
+    round_trip(R_GetProperty);
+    *type_ret = None; *format_ret = 0; *n_ret = 0; *after_ret = 0; *prop_ret = NULL;
+    Win *w = win_get(id);
+    Prop *p = w ? prop_get(w, atom) : NULL;
+    if (!p) return Success;
+    long n = p->n - off;
+    if (n < 0) n = 0;
+    if (n > len) n = len;
+    size_t unit = p->format == 32 ? sizeof(long) : (size_t)p->format / 8;
+    *prop_ret = malloc(unit * (n ? n : 1));
+    if (!*prop_ret) return BadAlloc;
+    memcpy(*prop_ret, p->data + unit * off, unit * n);
+    *type_ret = p->type; *format_ret = p->format;
+    *n_ret = (unsigned long)n;
+    *after_ret = (unsigned long)(p->n - off - n) * unit;
+    return Success;
+}
+
+int XChangeProperty(Display *d, Window id, Atom atom, Atom type, int format, int mode,
+                    _Xconst unsigned char *data, int n) {
+    (void)d; (void)mode;
+    request(R_ChangeProperty);
+    xstub_set_property(id, atom, type, format, data, n);
+    return 1;
+}
+
+Status XSetWMProtocols(Display *d, Window id, Atom *protocols, int n) {
+    Atom wm_protocols = XInternAtom(d, "WM_PROTOCOLS", False);
+    XChangeProperty(d, id, wm_protocols, XA_ATOM, 32, PropModeReplace, (unsigned char *)protocols, n);
+    return 1;
+}
+
+Status XQueryTree(Display *d, Window id, Window *root_ret, Window *parent_ret,
+                  Window **children_ret, unsigned int *n_ret) {
+    (void)d;
+    round_trip(R_QueryTree);
+    *root_ret = ROOT_ID;
+    *children_ret = NULL;
+    *n_ret = 0;
+    if (id != ROOT_ID) {
+        *parent_ret = ROOT_ID;
+        return win_get(id) != NULL;
+    }
+    *parent_ret = None;
+    if (!nwins) return 1;
+    *children_ret = malloc(nwins * sizeof(Window));
+    if (!*children_ret) return 0;
+    memcpy(*children_ret, order, nwins * sizeof(Window));
+    *n_ret = (unsigned int)nwins;
+    return 1;
+}
+
+int XMapWindow(Display *d, Window id) {
+    (void)d;
+    Win *w = win_get(id);
+    if (w) w->mapped = 1;
+    request(R_MapWindow);
+    return 1;
+}
+
+int XUnmapWindow(Display *d, Window id) {
+    (void)d;
+    Win *w = win_get(id);
+    if (w) w->mapped = 0;
+    request(R_UnmapWindow);
+    return 1;
+}
+
+int XRaiseWindow(Display *d, Window id) {
+    (void)d;
+    order_move(id, None, 1);
+    request(R_ConfigureWindow);
+    return 1;
+}
+
+int XRestackWindows(Display *d, Window *ws, int n) {
+    (void)d;
+    /* one ConfigureWindow per window after the first, as libX11 does */
+    for (int i = 1; i < n; ++i) {
+        order_move(ws[i], ws[i - 1], 0);
+        request(R_ConfigureWindow);
+    }
+    return 1;
+}
+
+int XMoveResizeWindow(Display *d, Window id, int x, int y, unsigned int wd, unsigned int ht) {
+    (void)d;
+    Win *w = win_get(id);
+    if (w) { w->x = x; w->y = y; w->w = wd; w->h = ht; }
+    request(R_ConfigureWindow);
+    return 1;
+}
+
+int XMoveWindow(Display *d, Window id, int x, int y) {
+    (void)d;
+    Win *w = win_get(id);
+    if (w) { w->x = x; w->y = y; }
+    request(R_ConfigureWindow);
+    return 1;
+}
+
+int XConfigureWindow(Display *d, Window id, unsigned int mask, XWindowChanges *ch) {
+    (void)d;
+    Win *w = win_get(id);
+    if (w) {
+        if (mask & CWX) w->x = ch->x;
+        if (mask & CWY) w->y = ch->y;
+        if (mask & CWWidth) w->w = (unsigned int)ch->width;
+        if (mask & CWHeight) w->h = (unsigned int)ch->height;
+        if (mask & CWBorderWidth) w->bw = (unsigned int)ch->border_width;
+    }
+    if (mask & CWStackMode)
+        order_move(id, (mask & CWSibling) ? ch->sibling : None, ch->stack_mode == Above);
+    request(R_ConfigureWindow);
+    return 1;
+}
+
+int XSetWindowBorderWidth(Display *d, Window id, unsigned int bw) {
+    (void)d;
+    Win *w = win_get(id);
+    if (w) w->bw = bw;
+    request(R_ConfigureWindow);
+    return 1;
+}
+
+int XSetWindowBorder(Display *d, Window id, unsigned long pixel) {
+    (void)d; (void)id; (void)pixel;
+    request(R_ChangeWindowAttributes);
+    return 1;
+}
+
+int XSetInputFocus(Display *d, Window id, int revert, Time t) {
+    (void)d; (void)id; (void)revert; (void)t;
+    request(R_SetInputFocus);
+    return 1;
+}
+
+Status XSendEvent(Display *d, Window id, Bool propagate, long mask, XEvent *ev) {
+    (void)d; (void)id; (void)propagate; (void)mask; (void)ev;
+    request(R_SendEvent);
+    return 1;
+}
+
+int XEventsQueued(Display *d, int mode) {
+    (void)d; (void)mode;
+    return qlen;
+}
+
+int XPending(Display *d) {
+    XFlush(d);
+    return qlen;
+}
+
+int XNextEvent(Display *d, XEvent *ev) {
+    (void)d;
+    if (!qlen) { memset(ev, 0, sizeof(*ev)); return 0; }
+    pop_at(0, ev);
+    /* the keys are held from a press until a modifier goes up */
+    if (ev->type == KeyPress) held_mods = ev->xkey.state;
+    else if (ev->type == KeyRelease && IsModifierKey(XLookupKeysym(&ev->xkey, 0))) held_mods = 0;
+    return 0;
+}
+
+int XPeekEvent(Display *d, XEvent *ev) {
+    (void)d;
+    if (!qlen) { memset(ev, 0, sizeof(*ev)); return 0; }
+    *ev = queue[qhead];
+    return 1;
+}
+
+Bool XCheckTypedEvent(Display *d, int type, XEvent *ev) {
+    (void)d;
+    for (int i = 0; i < qlen; ++i)
+        if (queue[qhead + i].type == type) { pop_at(i, ev); return True; }
+    return False;
+}
+
+Bool XCheckIfEvent(Display *d, XEvent *ev, Bool (*pred)(Display *, XEvent *, XPointer), XPointer arg) {
+    for (int i = 0; i < qlen; ++i)
+        if (pred(d, &queue[qhead + i], arg)) { pop_at(i, ev); return True; }
+    return False;
+}
+
+Bool XCheckMaskEvent(Display *d, long mask, XEvent *ev) {
+    (void)d;
+    for (int i = 0; i < qlen; ++i) {
+        int t = queue[qhead + i].type;
+        if (((mask & PointerMotionMask) && t == MotionNotify) ||
+            ((mask & ButtonReleaseMask) && t == ButtonRelease)) { pop_at(i, ev); return True; }
+    }
+    /* a drag without queued input ends straight away */
+    memset(ev, 0, sizeof(*ev));
+    ev->type = ButtonRelease;
+    return True;
+}
+
+/* --- xcb --- */
+xcb_connection_t *XGetXCBConnection(Display *d) { return (xcb_connection_t *)d; }
+
+xcb_get_window_attributes_cookie_t xcb_get_window_attributes(xcb_connection_t *c, xcb_window_t w) {
+    (void)c;
+    xcb_get_window_attributes_cookie_t ck = { xcb_query(R_GetWindowAttributes, w, None, 0) };
+    return ck;
+}
+
+xcb_get_window_attributes_reply_t *xcb_get_window_attributes_reply(xcb_connection_t *c,
+        xcb_get_window_attributes_cookie_t ck, xcb_generic_error_t **e) {
+    (void)c;
+    await_reply(ck.sequence);
+    if (e) *e = NULL;
+    Win *w = win_get(xcb_queries[ck.sequence % XCB_RING].win);
+    if (!w) return xcb_error(e, BadWindow);
+    xcb_get_window_attributes_reply_t *r = calloc(1, sizeof(*r));
+    if (!r) return NULL;
+    r->map_state = w->mapped ? XCB_MAP_STATE_VIEWABLE : XCB_MAP_STATE_UNMAPPED;
+    r->your_event_mask = (uint32_t)w->mask;
+    return r;
+}
+
+xcb_get_geometry_cookie_t xcb_get_geometry(xcb_connection_t *c, xcb_drawable_t d) {
+    (void)c;
+    xcb_get_geometry_cookie_t ck = { xcb_query(R_GetGeometry, d, None, 0) };
+    return ck;
+}
+
+xcb_get_geometry_reply_t *xcb_get_geometry_reply(xcb_connection_t *c, xcb_get_geometry_cookie_t ck,
+                                                 xcb_generic_error_t **e) {
+    (void)c;
+    await_reply(ck.sequence);
+    if (e) *e = NULL;
+    Win *w = win_get(xcb_queries[ck.sequence % XCB_RING].win);
+    if (!w) return xcb_error(e, BadDrawable);
+    xcb_get_geometry_reply_t *r = calloc(1, sizeof(*r));
+    if (!r) return NULL;
+    r->root = ROOT_ID;
+    r->x = (int16_t)w->x; r->y = (int16_t)w->y;
+    r->width = (uint16_t)w->w; r->height = (uint16_t)w->h;
+    r->border_width = (uint16_t)w->bw;
+    return r;
+}
+
+xcb_get_property_cookie_t xcb_get_property(xcb_connection_t *c, uint8_t del, xcb_window_t w,
+                                           xcb_atom_t prop, xcb_atom_t type, uint32_t off, uint32_t len) {
+    (void)c; (void)del; (void)type; (void)off;
+    xcb_get_property_cookie_t ck = { xcb_query(R_GetProperty, w, prop, (long)len) };
+    return ck;
+}
+
+xcb_get_property_reply_t *xcb_get_property_reply(xcb_connection_t *c, xcb_get_property_cookie_t ck,
+                                                 xcb_generic_error_t **e) {
+    (void)c;
+    await_reply(ck.sequence);
+    if (e) *e = NULL;
+    Win *w = win_get(xcb_queries[ck.sequence % XCB_RING].win);
+    if (!w) return xcb_error(e, BadWindow);
+    Prop *p = prop_get(w, xcb_queries[ck.sequence % XCB_RING].atom);
+    long n = p ? p->n : 0;
+    if (n > xcb_queries[ck.sequence % XCB_RING].len) n = xcb_queries[ck.sequence % XCB_RING].len;
+    int unit = p ? p->format / 8 : 0;
+    xcb_get_property_reply_t *r = calloc(1, sizeof(*r) + (size_t)(n * unit));
+    if (!r) return NULL;
+    if (!p) return r;
+    r->format = (uint8_t)p->format;
+    r->type = (xcb_atom_t)p->type;
+    r->value_len = (uint32_t)n;
+    unsigned char *out = (unsigned char *)(r + 1);
+    for (long i = 0; i < n; ++i) {
+        if (p->format == 32) {
+            uint32_t v = (uint32_t)((long *)p->data)[i];
+            memcpy(out + i * 4, &v, 4);
+        } else {
+            memcpy(out + i * unit, p->data + i * unit, unit);
+        }
+    }
+    return r;
+}
+
+void *xcb_get_property_value(const xcb_get_property_reply_t *r) { return (void *)(r + 1); }
+
+int xcb_get_property_value_length(const xcb_get_property_reply_t *r) {
+    return (int)(r->value_len * (r->format / 8));
+}
+
+int XGrabServer(Display *d) { (void)d; request(R_GrabServer); return 1; }
+int XUngrabServer(Display *d) { (void)d; request(R_UngrabServer); return 1; }
+
+GC XCreateGC(Display *d, Drawable dr, unsigned long mask, XGCValues *v) {
+    (void)d; (void)dr; (void)mask; (void)v;
+    request(R_CreateGC);
+    return NULL; /* opaque to the wm; never dereferenced */
+}
+
+int XDrawRectangle(Display *d, Drawable dr, GC gc, int x, int y, unsigned int w, unsigned int h) {
+    (void)d; (void)dr; (void)gc; (void)x; (void)y; (void)w; (void)h;
+    request(R_PolyRectangle);
+    return 1;
+}
+
+/* --- sync: reported missing, so clients are resized without waiting --- */
+Status XSyncQueryExtension(Display *d, int *event_base, int *error_base) {
+    (void)d;
+    *event_base = *error_base = 0;
+    round_trip(R_QueryExtension);
+    return False;
+}
+
+Status XSyncInitialize(Display *d, int *major, int *minor) {
+    (void)d;
+    *major = *minor = 0;
+    return False;
+}
+
+XSyncAlarm XSyncCreateAlarm(Display *d, unsigned long mask, XSyncAlarmAttributes *a) {
+    static XSyncAlarm next = 0x600000;
+    (void)d; (void)mask; (void)a;
+    return next++;
+}
+
+Status XSyncChangeAlarm(Display *d, XSyncAlarm alarm, unsigned long mask, XSyncAlarmAttributes *a) {
+    (void)d; (void)alarm; (void)mask; (void)a;
+    return 1;
+}
+
+Status XSyncDestroyAlarm(Display *d, XSyncAlarm alarm) { (void)d; (void)alarm; return 1; }
+
+void XSyncIntsToValue(XSyncValue *v, unsigned int lo, int hi) { v->lo = lo; v->hi = hi; }
+unsigned int XSyncValueLow32(XSyncValue v) { return v.lo; }
+int XSyncValueHigh32(XSyncValue v) { return v.hi; }
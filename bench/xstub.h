@@ -0,0 +1,41 @@
+/* xstub — a fake Xlib for headless benchmarks
+ *
+ * implements the Xlib calls wm.c makes against an in-memory window table
+ * and event queue, and counts what a real connection would have cost:
+ * protocol requests, round trips (calls that block on a reply) and
+ * writes of the output buffer to the socket.
+ */
+#ifndef XSTUB_H
+#define XSTUB_H
+
+#include <stdio.h>
+#include <X11/Xlib.h>
+
+typedef struct {
+    unsigned long events;      /* events handed to the wm */
+    unsigned long requests;    /* protocol requests issued */
+    unsigned long round_trips; /* requests the wm had to wait on */
+    unsigned long flushes;     /* output buffer writes */
+} XStubCounts;
+
+/* world building; windows are created as children of the root */
+Window xstub_create_window(int x, int y, unsigned int w, unsigned int h, int mapped);
+void xstub_set_property(Window w, Atom prop, Atom type, int format, const void *data, int n);
+Atom xstub_atom(const char *name); /* intern without counting a request */
+const Window *xstub_stacking(int *n); /* children of root, bottom first */
+
+/* events, appended to the queue */
+void xstub_push_event(const XEvent *ev);
+void xstub_map_request(Window w);
+void xstub_key_press(KeySym ks, unsigned int state);
+void xstub_key_release(KeySym ks, unsigned int state); /* a modifier going up clears XQueryPointer's mask */
+void xstub_motion(int x, int y, Window subwindow);
+void xstub_property_notify(Window w, Atom atom);
+int xstub_queued(void);
+
+/* accounting */
+void xstub_reset_counts(void);
+XStubCounts xstub_counts(void);
+void xstub_print_breakdown(FILE *out);
+
+#endif
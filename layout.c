@@ -0,0 +1,466 @@
+/* layout.c — tiling geometry for hsdwm (see layout.h) */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "layout.h"
+
+static Rect *layout_scratch = NULL;
+static int layout_scratch_cap = 0;
+
+Rect *layout_rects(int n) {
+    if (n > layout_scratch_cap) {
+        int ncap = layout_scratch_cap ? layout_scratch_cap : 16;
+        while (ncap < n) ncap *= 2;
+        Rect *r = realloc(layout_scratch, (size_t)ncap * sizeof(Rect));
+        if (!r) return NULL;
+        layout_scratch = r;
+        layout_scratch_cap = ncap;
+    }
+    return layout_scratch;
+}
+
+void layout_clamp_limits(int screen_w, int screen_h, unsigned int *max_w, unsigned int *max_h) {
+    *max_w = (unsigned int)(screen_w * 0.95);
+    *max_h = (unsigned int)(screen_h * 0.95);
+}
+
+void layout_clamp(unsigned int *w, unsigned int *h, unsigned int max_w, unsigned int max_h) {
+    if (*w < MIN_WIN_W) *w = MIN_WIN_W;
+    if (*h < MIN_WIN_H) *h = MIN_WIN_H;
+    if (*w > max_w) *w = max_w;
+    if (*h > max_h) *h = max_h;
+}
+
+static void master_rects(Rect *out, int count, int origin_x, int origin_y, int avail_w, int avail_h, int inner_gap, int factor) {
+    int master_w = (avail_w * factor) / 100;
+    if (master_w < MIN_WIN_W) master_w = MIN_WIN_W;
+
+    int stack_w = avail_w - master_w - inner_gap;
+    if (stack_w < MIN_WIN_W) stack_w = MIN_WIN_W;
+
+    int stack_count = count - 1;
+
+    int total_stack_gap = (stack_count > 0) ? (stack_count - 1) * inner_gap : 0;
+
+    // Calculate stack height accounting for gaps and borders
+    int stack_area_h = avail_h;
+    if (stack_count > 1) {
+        stack_area_h = avail_h - total_stack_gap;
+    }
+
+    int stack_each_h = (stack_count > 0) ? stack_area_h / stack_count : 0;
+    if (stack_count > 0 && stack_each_h < MIN_WIN_H) {
+        // If individual stack windows would be too small, recalculate
+        stack_each_h = MIN_WIN_H;
+        // Adjust stack_area_h to fit all windows with minimal height
+        if (stack_count > 1) {
+            stack_area_h = stack_count * stack_each_h + (stack_count - 1) * inner_gap;
+            // Adjust master height to accommodate stack height
+            int remaining_h = avail_h - stack_area_h;
+            if (remaining_h < MIN_WIN_H) {
+                // Distribute space more proportionally if not enough space
+                int total_req = MIN_WIN_H * count + (stack_count > 1 ? (stack_count - 1) * inner_gap : 0);
+                if (total_req > avail_h) {
+                    // Too small to accommodate all windows properly
+                    // Distribute available height equally
+                    master_w = avail_w / 2;
+                    stack_w = avail_w - master_w - inner_gap;
+                    stack_each_h = avail_h / count;
+                }
+            }
+        }
+    }
+
+    // Master window
+    out[0] = (Rect){ origin_x, origin_y, master_w, avail_h };
+
+    // Stack windows
+    for (int stack_idx = 0; stack_idx < stack_count; ++stack_idx) {
+        int ny = origin_y;
+        int nh = avail_h;
+
+        // Calculate the y position and height for each stack window
+        if (stack_count > 1) {
+            ny = origin_y + stack_idx * (stack_each_h + inner_gap);
+            nh = stack_each_h;
+            // For the last window, make sure it fills the remaining space
+            if (stack_idx == stack_count - 1) {
+                int used_space = stack_idx * (stack_each_h + inner_gap);
+                nh = avail_h - used_space;
+                if (nh < MIN_WIN_H) nh = MIN_WIN_H;
+            }
+        }
+
+        out[1 + stack_idx] = (Rect){ origin_x + master_w + inner_gap, ny, stack_w, nh };
+    }
+}
+
+/* dwindle: spiral like alternating splits. each client takes
+ * factor percent of what is left, the last one takes the rest.
+ * first split is vertical (client on the left), then horizontal (on top), ...
+ */
+static void dwindle_rects(Rect *out, int n, int x, int y, int w, int h, int inner_gap, int factor) {
+    int horiz = 0;
+    for (int i = 0; i < n; ++i) {
+        if (i == n - 1) {
+            out[i] = (Rect){ x, y, w, h };
+            break;
+        }
+        if (!horiz) {
+            int amount = (w * factor) / 100;
+            if (amount < MIN_WIN_W) amount = MIN_WIN_W;
+            if (amount > w - (MIN_WIN_W + inner_gap)) amount = w - (MIN_WIN_W + inner_gap);
+            if (amount < 1) amount = 1;
+
+            out[i] = (Rect){ x, y, amount, h };
+
+            // continue on the remaining area to the right
+            x += amount + inner_gap;
+            w -= amount + inner_gap;
+            if (w < MIN_WIN_W) w = MIN_WIN_W;
+        } else {
+            int amount = (h * factor) / 100;
+            if (amount < MIN_WIN_H) amount = MIN_WIN_H;
+            if (amount > h - (MIN_WIN_H + inner_gap)) amount = h - (MIN_WIN_H + inner_gap);
+            if (amount < 1) amount = 1;
+
+            out[i] = (Rect){ x, y, w, amount };
+
+            // continue on the remaining area below
+            y += amount + inner_gap;
+            h -= amount + inner_gap;
+            if (h < MIN_WIN_H) h = MIN_WIN_H;
+        }
+        horiz = !horiz;
+    }
+}
+
+/* count clients stacked in a column of a; the last one takes the slack */
+static void column_rects(Rect *out, int first, int step, int count, Rect a, int gap) {
+    if (count <= 0) return;
+    int each = (a.h - (count - 1) * gap) / count;
+    for (int k = 0; k < count; ++k)
+        out[first + k * step] = (Rect){ a.x, a.y + k * (each + gap), a.w, each };
+    Rect *last = &out[first + (count - 1) * step];
+    last->h = a.y + a.h - last->y;
+}
+
+/* master: nmaster clients in the left column, the rest stacked on the right */
+static void master_tile(Rect *out, int n, Rect a, int gap, const LayoutParams *p, LayoutState *st) {
+    (void)st;
+    int nm = p->nmaster;
+    if (nm == 1) {
+        master_rects(out, n, a.x, a.y, a.w, a.h, gap, p->master_factor);
+        return;
+    }
+    if (nm <= 0 || nm >= n) {
+        column_rects(out, 0, 1, n, a, gap);
+        return;
+    }
+    int mw = a.w * p->master_factor / 100;
+    if (mw > a.w - gap - MIN_WIN_W) mw = a.w - gap - MIN_WIN_W;
+    if (mw < MIN_WIN_W) mw = MIN_WIN_W;
+    column_rects(out, 0, 1, nm, (Rect){ a.x, a.y, mw, a.h }, gap);
+    column_rects(out, nm, 1, n - nm, (Rect){ a.x + mw + gap, a.y, a.w - mw - gap, a.h }, gap);
+}
+
+static void dwindle_tile(Rect *out, int n, Rect a, int gap, const LayoutParams *p, LayoutState *st) {
+    (void)st;
+    dwindle_rects(out, n, a.x, a.y, a.w, a.h, gap, p->master_factor);
+}
+
+/* monocle: every client takes the whole area, stacking decides what shows */
+static void monocle_tile(Rect *out, int n, Rect a, int gap, const LayoutParams *p, LayoutState *st) {
+    (void)gap; (void)p; (void)st;
+    for (int i = 0; i < n; ++i) out[i] = a;
+}
+
+/* grid: rows of ceil(sqrt(n)) columns; a short last row spreads out */
+static void grid_tile(Rect *out, int n, Rect a, int gap, const LayoutParams *p, LayoutState *st) {
+    (void)p; (void)st;
+    int cols = 1;
+    while (cols * cols < n) ++cols;
+    int rows = (n + cols - 1) / cols;
+    int row_h = (a.h - (rows - 1) * gap) / rows;
+    for (int r = 0, i = 0; r < rows; ++r) {
+        int in_row = r == rows - 1 ? n - i : cols;
+        int col_w = (a.w - (in_row - 1) * gap) / in_row;
+        int y = a.y + r * (row_h + gap);
+        int h = r == rows - 1 ? a.y + a.h - y : row_h;
+        for (int k = 0; k < in_row; ++k, ++i) {
+            int x = a.x + k * (col_w + gap);
+            out[i] = (Rect){ x, y, k == in_row - 1 ? a.x + a.w - x : col_w, h };
+        }
+    }
+}
+
+/* centred master: the masters in the middle, the stack alternating right
+ * and left of them; with a single stack client it is the master layout */
+static void centered_tile(Rect *out, int n, Rect a, int gap, const LayoutParams *p, LayoutState *st) {
+    int nm = p->nmaster < 1 ? 1 : p->nmaster;
+    if (n <= nm + 1) {
+        master_tile(out, n, a, gap, p, st);
+        return;
+    }
+    int mw = a.w * p->master_factor / 100;
+    if (mw < MIN_WIN_W) mw = MIN_WIN_W;
+    int side = (a.w - mw - 2 * gap) / 2;
+    if (side < MIN_WIN_W) side = MIN_WIN_W;
+    Rect left = { a.x, a.y, side, a.h };
+    Rect right = { a.x + a.w - side, a.y, side, a.h };
+    Rect middle = { a.x + side + gap, a.y, right.x - gap - (a.x + side + gap), a.h };
+    column_rects(out, 0, 1, nm, middle, gap);
+    column_rects(out, nm, 2, (n - nm + 1) / 2, right, gap);   /* right first */
+    column_rects(out, nm + 1, 2, (n - nm) / 2, left, gap);
+}
+
+/* --- bsp ---
+ * a tree of splits kept across passes. a new client splits one leaf and a
+ * closing one merges its parent, so every other window keeps its place.
+ * each split keeps its own ratio and cuts across the longer side.
+ */
+#define BSP_RATIO 50
+#define BSP_RATIO_MIN 10
+#define BSP_RATIO_MAX 90
+
+static BspNode *bsp_new(LayoutState *st) {
+    if (st->used == st->cap) {
+        int ncap = st->cap ? st->cap * 2 : 32;
+        BspNode *nodes = realloc(st->nodes, (size_t)ncap * sizeof(BspNode));
+        if (!nodes) return NULL;
+        st->nodes = nodes;
+        st->cap = ncap;
+    }
+    BspNode *nd = &st->nodes[st->used++];
+    nd->parent = -1;
+    nd->child[0] = nd->child[1] = -1;
+    nd->client = -1;
+    nd->ratio = BSP_RATIO;
+    return nd;
+}
+
+/* release node k by moving the last node into its slot */
+static void bsp_free(LayoutState *st, int k) {
+    int last = --st->used;
+    if (k == last) return;
+    BspNode *nd = &st->nodes[k];
+    *nd = st->nodes[last];
+    if (nd->parent < 0) st->root = k;
+    else st->nodes[nd->parent].child[st->nodes[nd->parent].child[1] == last] = k;
+    for (int c = 0; c < 2; ++c)
+        if (nd->child[c] >= 0) st->nodes[nd->child[c]].parent = k;
+}
+
+static int bsp_leaf(const LayoutState *st, int client) {
+    for (int k = 0; k < st->used; ++k)
+        if (st->nodes[k].child[0] < 0 && st->nodes[k].client == client) return k;
+    return -1;
+}
+
+static void bsp_insert(LayoutState *st, int i, int at) {
+    if (st->leaves < 0) return;
+    for (int k = 0; k < st->used; ++k)
+        if (st->nodes[k].child[0] < 0 && st->nodes[k].client >= i) ++st->nodes[k].client;
+
+    if (!st->leaves) {
+        st->used = 0;
+        BspNode *nd = bsp_new(st);
+        if (!nd) return;
+        nd->client = i;
+        st->root = 0;
+        st->leaves = 1;
+        return;
+    }
+    int t = bsp_leaf(st, at);
+    if (t < 0) t = bsp_leaf(st, i == 0 ? 1 : i - 1);
+    if (t < 0) { st->leaves = -1; return; } /* out of step; rebuilt on the next pass */
+    if (st->used + 2 > st->cap) {
+        /* grow first so the pointers below stay valid */
+        if (!bsp_new(st) || !bsp_new(st)) { st->leaves = -1; return; }
+        st->used -= 2;
+    }
+    int p = st->used, l = st->used + 1;
+    BspNode *pn = bsp_new(st), *ln = bsp_new(st), *tn = &st->nodes[t];
+    /* the split takes t's place, t keeps the first half */
+    pn->parent = tn->parent;
+    pn->child[0] = t;
+    pn->child[1] = l;
+    if (tn->parent < 0) st->root = p;
+    else st->nodes[tn->parent].child[st->nodes[tn->parent].child[1] == t] = p;
+    tn->parent = p;
+    ln->parent = p;
+    ln->client = i;
+    ++st->leaves;
+}
+
+static void bsp_remove(LayoutState *st, int i) {
+    if (st->leaves < 0) return;
+    int l = bsp_leaf(st, i);
+    if (l < 0) {
+        st->leaves = -1;
+        return;
+    }
+    int p = st->nodes[l].parent;
+    if (p < 0) {
+        st->used = 0;
+    } else {
+        /* the sibling takes the parent's place */
+        int sib = st->nodes[p].child[st->nodes[p].child[0] == l];
+        int gp = st->nodes[p].parent;
+        st->nodes[sib].parent = gp;
+        if (gp < 0) st->root = sib;
+        else st->nodes[gp].child[st->nodes[gp].child[1] == p] = sib;
+        /* free the higher slot first so the lower one is still where it was */
+        bsp_free(st, l > p ? l : p);
+        bsp_free(st, l > p ? p : l);
+    }
+    --st->leaves;
+    for (int k = 0; k < st->used; ++k)
+        if (st->nodes[k].child[0] < 0 && st->nodes[k].client > i) --st->nodes[k].client;
+}
+
+static int bsp_resize(LayoutState *st, int i, int delta) {
+    if (st->leaves < 0) return 0;
+    int l = bsp_leaf(st, i);
+    if (l < 0 || st->nodes[l].parent < 0) return 0;
+    BspNode *p = &st->nodes[st->nodes[l].parent];
+    int ratio = p->ratio + (p->child[0] == l ? delta : -delta);
+    if (ratio < BSP_RATIO_MIN) ratio = BSP_RATIO_MIN;
+    if (ratio > BSP_RATIO_MAX) ratio = BSP_RATIO_MAX;
+    if (ratio == p->ratio) return 0;
+    p->ratio = ratio;
+    return 1;
+}
+
+/* every leaf under k gets the same tile, stacking decides what shows */
+static void bsp_fill(const LayoutState *st, int k, Rect a, Rect *out) {
+    const BspNode *nd = &st->nodes[k];
+    if (nd->child[0] < 0) {
+        out[nd->client] = a;
+        return;
+    }
+    bsp_fill(st, nd->child[0], a, out);
+    bsp_fill(st, nd->child[1], a, out);
+}
+
+/* split along the longer side; a side too short for two minw x minh
+ * children is not split, so a deep spiral ends in a shared tile instead of
+ * going negative */
+static void bsp_rects(const LayoutState *st, int k, Rect a, int gap, int minw, int minh, Rect *out) {
+    const BspNode *nd = &st->nodes[k];
+    if (nd->child[0] < 0) {
+        out[nd->client] = a;
+        return;
+    }
+    int fits_w = a.w >= 2 * minw + gap, fits_h = a.h >= 2 * minh + gap;
+    if (!fits_w && !fits_h) {
+        bsp_fill(st, k, a, out);
+        return;
+    }
+    Rect first = a, second = a;
+    if (fits_w && (a.w >= a.h || !fits_h)) {
+        first.w = (a.w - gap) * nd->ratio / 100;
+        if (first.w < minw) first.w = minw;
+        if (first.w > a.w - gap - minw) first.w = a.w - gap - minw;
+        second.x = a.x + first.w + gap;
+        second.w = a.w - first.w - gap;
+    } else {
+        first.h = (a.h - gap) * nd->ratio / 100;
+        if (first.h < minh) first.h = minh;
+        if (first.h > a.h - gap - minh) first.h = a.h - gap - minh;
+        second.y = a.y + first.h + gap;
+        second.h = a.h - first.h - gap;
+    }
+    bsp_rects(st, nd->child[0], first, gap, minw, minh, out);
+    bsp_rects(st, nd->child[1], second, gap, minw, minh, out);
+}
+
+static void bsp_tile(Rect *out, int n, Rect a, int gap, const LayoutParams *p, LayoutState *st) {
+    static LayoutState scratch; /* for passes without a workspace */
+    if (!st) st = &scratch;
+    if (st->leaves != n) {
+        /* never seen this list (or lost track): grow it one client at a time */
+        st->used = 0;
+        st->leaves = 0;
+        for (int i = 0; i < n; ++i) bsp_insert(st, i, i - 1);
+        if (st->leaves != n) {
+            dwindle_rects(out, n, a.x, a.y, a.w, a.h, gap, p->master_factor);
+            return;
+        }
+    }
+    /* tiles are outer sizes; the border comes off in layout_arrange() */
+    bsp_rects(st, st->root, a, gap, MIN_WIN_W + 2 * p->border, MIN_WIN_H + 2 * p->border, out);
+}
+
+/* --- layout table --- */
+const Layout layouts[LAYOUT_COUNT] = {
+    [LAYOUT_MASTER]   = { "master",   master_tile,   NULL,       NULL,       NULL },
+    [LAYOUT_DWINDLE]  = { "dwindle",  dwindle_tile,  NULL,       NULL,       NULL },
+    [LAYOUT_MONOCLE]  = { "monocle",  monocle_tile,  NULL,       NULL,       NULL },
+    [LAYOUT_GRID]     = { "grid",     grid_tile,     NULL,       NULL,       NULL },
+    [LAYOUT_CENTERED] = { "centered", centered_tile, NULL,       NULL,       NULL },
+    [LAYOUT_BSP]      = { "bsp",      bsp_tile,      bsp_insert, bsp_remove, bsp_resize },
+};
+
+int layout_find(const char *name) {
+    for (int i = 0; i < LAYOUT_COUNT; ++i)
+        if (strcmp(layouts[i].name, name) == 0) return i;
+    return -1;
+}
+
+void layout_insert(LayoutState *st, int i, int at) {
+    for (int l = 0; l < LAYOUT_COUNT; ++l)
+        if (layouts[l].insert) layouts[l].insert(st, i, at);
+}
+
+void layout_remove(LayoutState *st, int i) {
+    for (int l = 0; l < LAYOUT_COUNT; ++l)
+        if (layouts[l].remove) layouts[l].remove(st, i);
+}
+
+int layout_resize(int layout, LayoutState *st, int i, int delta) {
+    if (layout < 0 || layout >= LAYOUT_COUNT || !layouts[layout].resize || !st) return 0;
+    return layouts[layout].resize(st, i, delta);
+}
+
+void layout_arrange(int layout, const LayoutParams *p, LayoutState *st, int n, Rect *out) {
+    if (n <= 0) return;
+    if (layout < 0 || layout >= LAYOUT_COUNT) layout = LAYOUT_MASTER;
+
+    /* everything that does not depend on the client is settled here, once */
+    int outer_gap = p->gap_outer < 0 ? 0 : p->gap_outer;
+    int inner_gap = p->gap_inner < 0 ? 0 : p->gap_inner;
+    int b = p->border;
+
+    // effective outer gap does NOT include border thickness (border is handled per window)
+    int avail_w = p->screen_w - 2 * outer_gap - p->reserve_left - p->reserve_right;
+    int avail_h = p->screen_h - 2 * outer_gap - p->reserve_top - p->reserve_bottom;
+    if (avail_w < MIN_WIN_W) avail_w = MIN_WIN_W;
+    if (avail_h < MIN_WIN_H) avail_h = MIN_WIN_H;
+
+    Rect area = {
+        p->screen_x + outer_gap + p->reserve_left,
+        p->screen_y + outer_gap + p->reserve_top,
+        avail_w, avail_h
+    };
+
+    // if a single client just fill area, otherwise use the requested layout
+    if (n == 1) out[0] = area;
+    else layouts[layout].tile(out, n, area, inner_gap, p, st);
+
+    unsigned int max_w = p->max_w, max_h = p->max_h;
+    if (!max_w || !max_h) layout_clamp_limits(p->screen_w, p->screen_h, &max_w, &max_h);
+    for (int i = 0; i < n; ++i) {
+        int iw = out[i].w, ih = out[i].h;
+        // Subtract borders after calculating the base dimensions
+        if (iw > 2 * b) iw -= 2 * b;
+        if (ih > 2 * b) ih -= 2 * b;
+        // a degenerate tile goes to the minimum, not through the unsigned cast
+        unsigned int w = iw > 0 ? (unsigned int)iw : 0;
+        unsigned int h = ih > 0 ? (unsigned int)ih : 0;
+        layout_clamp(&w, &h, max_w, max_h);
+        out[i].w = (int)w;
+        out[i].h = (int)h;
+    }
+}
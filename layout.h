@@ -0,0 +1,103 @@
+/* layout.h — tiling geometry for hsdwm
+ *
+ * pure functions over plain rects: no X calls, no globals from wm.c, so
+ * they can be driven headless (see bench/layout_bench.c).
+ */
+#ifndef HSDWM_LAYOUT_H
+#define HSDWM_LAYOUT_H
+
+#define MIN_WIN_W      32
+#define MIN_WIN_H      24
+
+enum {
+    LAYOUT_MASTER = 0,
+    LAYOUT_DWINDLE,
+    LAYOUT_MONOCLE,
+    LAYOUT_GRID,
+    LAYOUT_CENTERED,
+    LAYOUT_BSP,
+    LAYOUT_COUNT
+};
+
+typedef struct { int x, y, w, h; } Rect;
+
+/* a split of the bsp layout; leaves stand for one client each */
+typedef struct {
+    int parent;         /* -1 for the root */
+    int child[2];       /* -1 in leaves */
+    int client;         /* list position, leaves only */
+    int ratio;          /* percent of the area given to child[0] */
+} BspNode;
+
+/* what a layout keeps for a workspace between passes; zeroed == empty */
+typedef struct {
+    BspNode *nodes;
+    int used, cap;
+    int root;
+    int leaves;
+} LayoutState;
+
+/* everything a layout pass depends on */
+typedef struct {
+    int screen_x, screen_y;  /* origin of the output being laid out */
+    int screen_w, screen_h;
+    /* reserved dock areas per edge */
+    int reserve_top, reserve_bottom, reserve_left, reserve_right;
+    int gap_outer;      /* outer gap on both sides */
+    int gap_inner;      /* gap between tiled windows */
+    int border;         /* border width, subtracted from each window */
+    int master_factor;  /* percent of the area given to the master area / first split */
+    int nmaster;        /* windows in the master area */
+    unsigned int max_w, max_h; /* window size limits, 0 = layout_clamp_limits() */
+} LayoutParams;
+
+/* scratch for one rect per client, grown on demand and reused by every pass
+ * so steady-state layout does no heap allocation. NULL on allocation failure.
+ */
+Rect *layout_rects(int n);
+
+/* a layout tiles n clients, in list order, into area with gap pixels
+ * between them; it reads master_factor and nmaster from p where they
+ * make sense.
+ * stateful layouts may also follow the client list through the optional
+ * insert/remove hooks, so a change only moves the windows it touches.
+ */
+typedef struct {
+    const char *name;
+    void (*tile)(Rect *out, int n, Rect area, int gap, const LayoutParams *p, LayoutState *st);
+    void (*insert)(LayoutState *st, int i, int at); /* client i added, splitting at */
+    void (*remove)(LayoutState *st, int i);         /* client i gone */
+    int (*resize)(LayoutState *st, int i, int delta); /* grow client i's split */
+} Layout;
+
+extern const Layout layouts[LAYOUT_COUNT];
+
+/* index of the layout called name, -1 if there is none */
+int layout_find(const char *name);
+
+/* keep st in step with a workspace's client list: a client was inserted at
+ * position i (at is the position of the client whose tile it should share,
+ * after the insert), or the client at i went away. works for every layout,
+ * so the state is current whenever a stateful layout gets selected.
+ */
+void layout_insert(LayoutState *st, int i, int at);
+void layout_remove(LayoutState *st, int i);
+
+/* grow (delta > 0) or shrink the split holding client i by delta percent.
+ * returns 0 when the layout keeps no ratios of its own, or nothing moved.
+ */
+int layout_resize(int layout, LayoutState *st, int i, int delta);
+
+/* compute the final window rects of n tiled clients, in list order:
+ * borders subtracted and sizes clamped like every other managed window.
+ * st may be NULL for a one-off pass.
+ */
+void layout_arrange(int layout, const LayoutParams *p, LayoutState *st, int n, Rect *out);
+
+/* largest window on a screen_w x screen_h output: 95% of it each way */
+void layout_clamp_limits(int screen_w, int screen_h, unsigned int *max_w, unsigned int *max_h);
+
+/* clamp a window size to [MIN_WIN, max] */
+void layout_clamp(unsigned int *w, unsigned int *h, unsigned int max_w, unsigned int max_h);
+
+#endif
@@ -1,11 +1,16 @@
-/* hsdwm — dock handling tightened + dwindle layout
+/* hsdwm — a small tiling window manager for X11
  *
- * added:
- *  - dwindle layout (spiral split) alongside existing master layout
- *  - workspace_layout[] and DEFAULT_LAYOUT_NAME to pick default layout by name
- *  - set_workspace_layout() / set_layout_for_all() helpers
+ *  - layouts live in a table in layout.c: master, dwindle, monocle, grid,
+ *    centered and bsp; each workspace has its own layout, mfact, nmaster
+ *    and gaps (workspace_layout[], Workspace.tune[])
+ *  - docks reserve struts per output; the work area is published as
+ *    _NET_WORKAREA
+ *  - ~/.wm/config overrides the #defines below and is reloaded on save
+ *  - ~/.wm/ctl is a control socket taking one command per line
  *
- * usage: edit DEFAULT_LAYOUT_NAME near the top or call set_workspace_layout()
+ * usage: the #defines below are the compiled-in defaults; DEFAULT_LAYOUT_NAME
+ * picks the starting layout by name, `layout NAME` in the config or
+ * `layout N NAME` on the socket changes it later.
  */
 
 #ifndef BORDER_PX_FOCUSED
@@ -36,8 +41,56 @@
 #  define DEFAULT_MASTER_FACTOR 60  /* percent width for master area */
 #endif
 
+#ifndef DEFAULT_NMASTER
+#  define DEFAULT_NMASTER 1  /* windows in the master area */
+#endif
+
+#ifndef DEFAULT_GAP_OUTER
+#  define DEFAULT_GAP_OUTER 0  /* outer gap on both sides */
+#endif
+
+#ifndef DEFAULT_GAP_INNER
+#  define DEFAULT_GAP_INNER 0  /* gap between tiled windows */
+#endif
+
+#ifndef GAP_STEP
+#  define GAP_STEP 2  /* pixels the inner gap moves per super+shift+comma/period */
+#endif
+
+#ifndef TERMINAL_CMD
+#  define TERMINAL_CMD "xterm"
+#endif
+
+#ifndef LAUNCHER_CMD
+#  define LAUNCHER_CMD "dmenu_run"
+#endif
+
+#ifndef HIDE_OFFSCREEN
+#  define HIDE_OFFSCREEN 0  /* 1 = park hidden workspaces off-screen, mapped, instead of unmapping */
+#endif
+
+#ifndef DRAG_FPS
+#  define DRAG_FPS 60  /* max geometry updates per second while moving/resizing */
+#endif
+
+#ifndef DRAG_OUTLINE
+#  define DRAG_OUTLINE 0  /* 1 = drag an outline, apply the geometry on release */
+#endif
+
+#ifndef SYNC_TIMEOUT_MS
+#  define SYNC_TIMEOUT_MS 250  /* stop waiting for a client to paint a resize after this */
+#endif
+
+#ifndef SPLIT_STEP
+#  define SPLIT_STEP 5  /* percent a split ratio or the master factor moves per super+comma/period */
+#endif
+
+#ifndef WM_STATS
+#  define WM_STATS 0  /* 1 = handler timings and X traffic per event type (ipc "stats", SIGUSR1) */
+#endif
+
 #ifndef DEFAULT_LAYOUT_NAME
-#  define DEFAULT_LAYOUT_NAME "dwindle"  /* master  or  dwindle */
+#  define DEFAULT_LAYOUT_NAME "dwindle"  /* master dwindle monocle grid centered bsp */
 #endif
 
 #define _POSIX_C_SOURCE 200809L
@@ -47,10 +100,27 @@
 #include <X11/keysym.h>
 #include <X11/cursorfont.h>
 #include <X11/Xutil.h>
+#include <X11/Xlib-xcb.h>
+#include <X11/extensions/sync.h>
+#ifdef XRANDR
+#include <X11/extensions/Xrandr.h>
+#endif
+#include <xcb/xcb.h>
 #include <limits.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -59,33 +129,55 @@
 #include <signal.h>
 #include <sys/wait.h>
 
+#include "layout.h"
+
 /* --- constants --- */
 #define MOVE_CURSOR    XC_fleur
 #define RESIZE_CURSOR  XC_sizing
-#define MIN_WIN_W      32
-#define MIN_WIN_H      24
 #define MAX_WORKSPACES 9
 
-static char *term_cmd[]  = { "xterm", NULL };
-static char *dmenu_cmd[] = { "dmenu_run", NULL };
-
-/* --- gap configuration (edit before compile) --- */
-static int gap_outer = 0;   /* outer gap on both sides */
-static int gap_inner = 0;   /* gap between master and stack */
+/* per-workspace layout knobs, changeable at runtime (keys, control socket);
+ * DEFAULT_* and the config file only say where every workspace starts */
+enum { TUNE_MFACT, TUNE_NMASTER, TUNE_GAP_INNER, TUNE_GAP_OUTER, TUNE_COUNT };
+static const struct { const char *name; int min, max; } tunables[TUNE_COUNT] = {
+    [TUNE_MFACT]     = { "mfact",     5, 95 },
+    [TUNE_NMASTER]   = { "nmaster",   0, 16 },
+    [TUNE_GAP_INNER] = { "gap_inner", 0, 200 },
+    [TUNE_GAP_OUTER] = { "gap_outer", 0, 200 },
+};
 
 /* --- modes --- */
 enum { MODE_FLOATING = 0, MODE_TILING = 1 };
 
-/* --- layouts --- */
-enum { LAYOUT_MASTER = 0, LAYOUT_DWINDLE = 1 };
+/* --- layouts (geometry lives in layout.c) --- */
 static int workspace_layout[MAX_WORKSPACES];
-static const char *layout_names[] = { "master", "dwindle" };
 
 /* --- client --- */
+enum { BORDER_WIDTH = 1, BORDER_COLOR = 2 };
+
 typedef struct Client {
     Window win;
     int x, y;
     unsigned int w, h;
+    /* geometry last sent to the server (valid once configured is set) */
+    int ax, ay;
+    unsigned int aw, ah;
+    int configured;
+    /* border last sent to the server; border_set says which parts are known */
+    unsigned int abw;
+    unsigned long abcol;
+    int border_set;     /* BORDER_WIDTH | BORDER_COLOR */
+    int amapped;              /* map state last sent to (or seen from) the server */
+    int hidden;               /* on a hidden workspace: unmapped or parked off-screen */
+    int unmaps_expected;      /* UnmapNotify events our own unmaps will cause */
+    /* _NET_WM_SYNC_REQUEST: resizes wait until the last one was painted */
+    XSyncCounter sync_counter;  /* None if the client does not take part */
+    XSyncAlarm sync_alarm;
+    int64_t sync_value;         /* last value asked for */
+    int sync_waiting;
+    long long sync_deadline;    /* ms, see now_ms() */
+    unsigned long stack_seq;  /* when last raised; higher stacks above */
+    int stack_pos;            /* index in the applied stack (see restack) */
     int workspace; /* -1 == global (docks) */
     int is_dock;
     /* primary 4 struts */
@@ -104,16 +196,93 @@ typedef struct Client {
     unsigned long strut_bottom_end_x;
     struct Client *next;
     struct Client *prev;
+    /* per-workspace list, in layout order */
+    struct Client *ws_next;
+    struct Client *ws_prev;
+    struct Client *mru_next;  /* ring of the workspace, most recently focused first */
+    struct Client *mru_prev;
 } Client;
 
+/* --- directional focus index (see find_neighbor_in_direction) --- */
+typedef struct {
+    Client *c;
+    int lo[2], hi[2];   /* [0] = x extent, [1] = y extent */
+    int ord;            /* position in the workspace list */
+} EdgeEntry;
+
+typedef struct {
+    EdgeEntry *entries;
+    EdgeEntry **by_lo[2];
+    EdgeEntry **by_hi[2];
+    int n, cap;
+    int max_ext[2];     /* widest / tallest client */
+    int valid;
+} EdgeIndex;
+
+/* --- pipelined window queries ---
+ * everything manage() wants to know about a window goes out as one burst of
+ * xcb requests; the replies are collected afterwards, so a window costs one
+ * round trip however many things we ask about it.
+ */
+typedef struct {
+    xcb_get_window_attributes_cookie_t attr;
+    xcb_get_geometry_cookie_t geom;
+    xcb_get_property_cookie_t type;
+    xcb_get_property_cookie_t strut;
+    xcb_get_property_cookie_t protocols;
+    xcb_get_property_cookie_t sync_counter;
+    int override_redirect;  /* filled in by collect_window() */
+    int viewable;
+    XSyncCounter counter;   /* None unless the client speaks _NET_WM_SYNC_REQUEST */
+} WindowQuery;
+
+/* --- workspaces --- */
+typedef struct {
+    Client *head;   /* first client == master */
+    Client *mru;    /* most recently focused, front of the mru ring */
+    int count;
+    int dirty;      /* needs a layout pass when shown */
+    int ox, oy;     /* origin of the output its clients were placed for */
+    EdgeIndex edges;
+    LayoutState lstate; /* what stateful layouts keep between passes */
+    int tune[TUNE_COUNT];
+} Workspace;
+
+/* --- window -> client index ---
+ * open addressing with linear probing; deletion uses backward shift so the
+ * table never accumulates tombstones. cap is always a power of two.
+ */
+typedef struct {
+    Window win;
+    Client *c;
+} WinSlot;
+
+typedef struct {
+    WinSlot *slots;
+    size_t cap;
+    size_t len;
+} WinMap;
+
+#define WINMAP_MIN_CAP 64
+
 /* --- globals --- */
 static Display *dpy;
+static xcb_connection_t *xc;    /* same connection, for pipelined queries */
 static int screen_num;
 static Window root;
 
 static Client *clients = NULL;
 static Client *focused = NULL;
-static Client *cycle_start = NULL;
+static Window pointer_window = None; /* root child under the pointer at the last motion */
+static Client *drawn_focus = NULL;   /* client whose border is drawn focused */
+
+static WinMap client_index;   /* managed window -> client */
+static WinMap ancestry;       /* subwindow -> toplevel client (cache) */
+static WinMap sync_alarms;    /* sync alarm -> client */
+
+static Cursor cursor_move;
+static Cursor cursor_resize;
+static GC outline_gc;         /* only with DRAG_OUTLINE */
 
 static unsigned long border_focus_col;
 static unsigned long border_unfocus_col;
@@ -129,30 +298,81 @@ static Atom NET_WM_WINDOW_TYPE_DOCK;
 static Atom NET_WM_STRUT_PARTIAL;
 static Atom NET_WM_STATE;
 static Atom NET_WM_STATE_ABOVE;
+static Atom NET_WORKAREA;
+static Atom NET_WM_SYNC_REQUEST;
+static Atom NET_WM_SYNC_REQUEST_COUNTER;
+
+static int have_sync = 0;     /* server has the SYNC extension */
+static int sync_event_base;
+static int sync_waiting = 0;  /* clients currently painting a resize */
+
+static int signal_fd = -1;         /* SIGCHLD, read by run_loop() */
+static sigset_t child_sigmask;     /* mask to restore before exec */
 
 static int current_workspace = 0;
 static int cycling = 0;
+static int cycle_grabbed = 0;       /* keyboard held so the modifier release comes to us */
+static unsigned int cycle_mods = 0; /* modifiers that keep the cycle going */
 
 static int tag_mode[MAX_WORKSPACES];
+static Workspace workspaces[MAX_WORKSPACES];
 
-/* reserved area computed from docks */
-static int reserved_top = 0;
-static int reserved_bottom = 0;
-static int reserved_left = 0;
-static int reserved_right = 0;
+/* --- outputs ---
+ * monitors as RandR reports them (built with XRANDR), else the whole screen
+ * as one. geometry is cached here and only re-read when the screen changes,
+ * so layout never asks the server. every output shows a workspace of its
+ * own and reserves its own dock area.
+ */
+#define MAX_OUTPUTS 8   /* fewer than MAX_WORKSPACES, so each gets one */
+
+typedef struct {
+    int x, y, w, h;             /* usable area, docks subtracted */
+    unsigned int max_w, max_h;  /* largest window, see layout_clamp_limits() */
+} WorkArea;
+
+typedef struct {
+    int x, y, w, h;
+    int workspace;      /* shown on this output */
+    /* reserved area computed from docks */
+    int reserve_top, reserve_bottom, reserve_left, reserve_right;
+    WorkArea wa;        /* follows from the above, see update_work_areas() */
+} Output;
+
+static Output outputs[MAX_OUTPUTS];
+static int noutputs = 0;
+static int current_output = 0;         /* the one showing current_workspace */
+static int ws_output[MAX_WORKSPACES];  /* output showing a workspace, -1 if hidden */
+static int screen_w, screen_h;         /* root window size */
+#ifdef XRANDR
+static int have_randr = 0;
+static int randr_event_base;
+#endif
+
+/* --- deferred requests ---
+ * handlers only record what they want done; flush_pending() sends the merged
+ * result once per event-loop iteration, after every queued event is handled.
+ */
+static struct {
+    Client *focus;          /* client to receive input focus */
+    int borders;            /* borders/raise/dock restack needed */
+    unsigned int arrange;   /* bitmask of workspaces to re-tile */
+    int status;             /* state export may be out of date */
+    int restack;            /* wanted stacking order may have changed */
+    int workarea;           /* _NET_WORKAREA may be out of date */
+} pending;
 
 /* --- prototypes --- */
 static void spawn_program(char *const argv[]);
 static void send_wm_delete(Window w);
 static void toggle_fullscreen(Client *c);
-static void write_focused_workspace_file(int ws_index);
-static void write_occupied_workspace_file(void);
+static void export_state(void);
 static void update_borders(void);
+static void flush_pending(void);
 static Client *find_toplevel_client_from_window(Window w);
 static void focus_client_proper(Client *c);
-static void focus_window_at_pointer(void);
+static void focus_window_at_pointer(Window w);
 static void move_focused_to_workspace(int ws);
-static void start_cycle(void);
+static void start_cycle(unsigned int mods);
 static void cycle_focus(int forward);
 static void stop_cycle(void);
 
@@ -161,11 +381,6 @@ static void set_workspace_mode(int ws, int mode);
 static void set_mode_for_all(int mode);
 static void focus_in_direction(int dir);
 
-static void sigchld_handler(int sig) {
-    (void)sig;
-    while (waitpid(-1, NULL, WNOHANG) > 0);
-}
-
 /* new: improved neighbor finder + swap */
 static Client *find_neighbor_in_direction(Client *cur, int dir);
 static void swap_clients(Client *a, Client *b);
@@ -173,22 +388,142 @@ static void swap_clients_keep_focus(Client *a, Client *b); /* new helper */
 
 /* dock helpers */
 static void get_window_type_and_strut(Window w, Client *c);
-static void update_global_struts(void);
+static unsigned int update_global_struts(void);
+static void update_struts(void);
+static void queue_arrange(int ws);
 static void set_dock_above_property(Window w);
-static void restack_docks(void);
+static void restack(void);
 static void apply_dock_geometry(Client *c); /* compute & enforce geometry from strut */
 static void handle_propertynotify(XEvent *ev);
 
-/* dwindle helpers */
-static void dwindle_tile(Client **arr, int start, int n, int x, int y, int w, int h, int horiz, int b, int inner_gap);
-static Client **collect_workspace_clients(int ws, int *out_count);
-
 /* --- helpers --- */
 static void die(const char *msg) {
     fprintf(stderr, "wm: %s\n", msg);
     exit(EXIT_FAILURE);
 }
 
+/* --- instrumentation ---
+ * with WM_STATS, run_loop() times every handler and charges it the X
+ * requests, reply waits and layout passes it caused, one row per event
+ * type plus rows for the loop's own stages (timers, flush, control socket,
+ * config reload). handlers only queue work, so layout and most requests
+ * show up under flush. a reply wait counts as a round trip unless an
+ * earlier one already covered its request, as in bench/xstub.c.
+ * `stats` on the control socket reads it, SIGUSR1 dumps it to stderr.
+ * without WM_STATS every hook below is an empty function.
+ */
+#define STAT_BUCKETS 16 /* handler time, <1us, <2us, <4us ... <16384us, rest */
+
+enum { STAT_EXTENSION = LASTEvent, STAT_TIMERS, STAT_FLUSH, STAT_IPC, STAT_CONFIG, STAT_ROWS };
+
+static const char *const stat_names[STAT_ROWS] = {
+    [KeyPress] = "KeyPress", [KeyRelease] = "KeyRelease", [ButtonPress] = "ButtonPress",
+    [ButtonRelease] = "ButtonRelease", [MotionNotify] = "MotionNotify", [EnterNotify] = "EnterNotify",
+    [LeaveNotify] = "LeaveNotify", [FocusIn] = "FocusIn", [FocusOut] = "FocusOut",
+    [KeymapNotify] = "KeymapNotify", [Expose] = "Expose", [GraphicsExpose] = "GraphicsExpose",
+    [NoExpose] = "NoExpose", [VisibilityNotify] = "VisibilityNotify", [CreateNotify] = "CreateNotify",
+    [DestroyNotify] = "DestroyNotify", [UnmapNotify] = "UnmapNotify", [MapNotify] = "MapNotify",
+    [MapRequest] = "MapRequest", [ReparentNotify] = "ReparentNotify", [ConfigureNotify] = "ConfigureNotify",
+    [ConfigureRequest] = "ConfigureRequest", [GravityNotify] = "GravityNotify", [ResizeRequest] = "ResizeRequest",
+    [CirculateNotify] = "CirculateNotify", [CirculateRequest] = "CirculateRequest", [PropertyNotify] = "PropertyNotify",
+    [SelectionClear] = "SelectionClear", [SelectionRequest] = "SelectionRequest", [SelectionNotify] = "SelectionNotify",
+    [ColormapNotify] = "ColormapNotify", [ClientMessage] = "ClientMessage", [MappingNotify] = "MappingNotify",
+    [GenericEvent] = "GenericEvent",
+    [STAT_EXTENSION] = "extension", [STAT_TIMERS] = "timers", [STAT_FLUSH] = "flush",
+    [STAT_IPC] = "ipc", [STAT_CONFIG] = "config",
+};
+
+typedef struct {
+    unsigned long n, requests, round_trips, layouts;
+    uint64_t ns, max_ns;
+    unsigned long hist[STAT_BUCKETS];
+} StatRow;
+
+typedef struct {
+    uint64_t ns;
+    unsigned long request, round_trips, layouts;
+} StatMark;
+
+static StatRow stat_rows[STAT_ROWS];
+static unsigned long stat_round_trips = 0; /* running totals the marks diff */
+static unsigned long stat_layouts = 0;
+static unsigned int stat_answered = 0;     /* last request a reply wait covered */
+
+static uint64_t stat_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/* about to wait for the reply to request seq (an xcb cookie's sequence) */
+static void stat_reply(unsigned int seq) {
+    if (!WM_STATS || (int)(seq - stat_answered) <= 0) return;
+    ++stat_round_trips;
+    stat_answered = (unsigned int)(XNextRequest(dpy) - 1);
+}
+
+/* just waited on an Xlib call that always blocks */
+static void stat_sync(void) {
+    if (!WM_STATS) return;
+    ++stat_round_trips;
+    stat_answered = (unsigned int)(XNextRequest(dpy) - 1);
+}
+
+static void stat_layout(void) {
+    if (WM_STATS) ++stat_layouts;
+}
+
+static void stat_begin(StatMark *m) {
+    if (!WM_STATS) return;
+    m->request = XNextRequest(dpy);
+    m->round_trips = stat_round_trips;
+    m->layouts = stat_layouts;
+    m->ns = stat_now();
+}
+
+static void stat_end(int row, const StatMark *m) {
+    if (!WM_STATS) return;
+    uint64_t ns = stat_now() - m->ns;
+    StatRow *r = &stat_rows[row];
+    ++r->n;
+    r->ns += ns;
+    if (ns > r->max_ns) r->max_ns = ns;
+    r->requests += XNextRequest(dpy) - m->request;
+    r->round_trips += stat_round_trips - m->round_trips;
+    r->layouts += stat_layouts - m->layouts;
+    int b = 0;
+    for (uint64_t us = ns / 1000; us && b < STAT_BUCKETS - 1; us >>= 1) ++b;
+    ++r->hist[b];
+}
+
+static int stat_find(const char *name) {
+    for (int i = 0; i < STAT_ROWS; ++i)
+        if (stat_names[i] && strcmp(name, stat_names[i]) == 0) return i;
+    return -1;
+}
+
+/* one row on one line; returns the length like snprintf */
+static int stat_format(char *buf, size_t size, int row) {
+    const StatRow *r = &stat_rows[row];
+    int len = snprintf(buf, size, "events=%lu mean_us=%llu max_us=%llu requests=%lu round_trips=%lu layouts=%lu hist=",
+                       r->n, r->n ? (unsigned long long)(r->ns / r->n / 1000) : 0ull,
+                       (unsigned long long)(r->max_ns / 1000), r->requests, r->round_trips, r->layouts);
+    for (int b = 0; b < STAT_BUCKETS && len >= 0 && (size_t)len < size; ++b)
+        len += snprintf(buf + len, size - len, b ? ",%lu" : "%lu", r->hist[b]);
+    return len;
+}
+
+static void stats_dump(FILE *out) {
+    char line[256];
+    fprintf(out, "wm stats (hist: <1us <2us <4us ... <16384us rest)\n");
+    for (int i = 0; i < STAT_ROWS; ++i) {
+        if (!stat_rows[i].n) continue;
+        stat_format(line, sizeof(line), i);
+        fprintf(out, "  %-16s %s\n", stat_names[i] ? stat_names[i] : "?", line);
+    }
+    fflush(out);
+}
+
 static int xerror_handler(Display *d, XErrorEvent *ev) {
     char buf[128];
     XGetErrorText(d, ev->error_code, buf, sizeof(buf));
@@ -200,107 +535,559 @@ static int xerror_handler(Display *d, XErrorEvent *ev) {
 static unsigned long alloc_color(const char *name) {
     XColor col, dummy;
     Colormap cmap = DefaultColormap(dpy, screen_num);
-    if (!XAllocNamedColor(dpy, cmap, name, &col, &dummy)) {
+    int ok = XAllocNamedColor(dpy, cmap, name, &col, &dummy);
+    stat_sync();
+    if (!ok) {
         return BlackPixel(dpy, screen_num);
     }
     return col.pixel;
 }
 
-static void ensure_wm_dir(void) {
+/* --- state export ---
+ * focused.workspace and occupied.workspace keep their text format for
+ * existing bars; ~/.wm/status is a fixed-layout block that bars can mmap
+ * instead of polling files. nothing is written unless a value changed.
+ */
+#define STATUS_MAGIC   0x57445348u /* "HSDW" */
+#define STATUS_VERSION 1u
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;                       /* odd while an update is in progress */
+    int32_t focused_ws;                 /* 1-based */
+    uint32_t occupied_mask;             /* bit n set == workspace n+1 has windows */
+    uint32_t nclients[MAX_WORKSPACES];
+} StatusBlock;
+
+static char focused_path[PATH_MAX];
+static char occupied_path[PATH_MAX];
+static StatusBlock *status_block = NULL;
+static int exported_focused = -1;
+static int exported_occupied = -1;
+
+static void init_state_export(void) {
     const char *home = getenv("HOME");
     if (!home) return;
     char path[PATH_MAX];
     snprintf(path, sizeof(path), "%s/.wm", home);
     struct stat st;
     if (stat(path, &st) == -1) mkdir(path, 0700);
+    snprintf(focused_path, sizeof(focused_path), "%s/.wm/focused.workspace", home);
+    snprintf(occupied_path, sizeof(occupied_path), "%s/.wm/occupied.workspace", home);
+
+    snprintf(path, sizeof(path), "%s/.wm/status", home);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return;
+    if (ftruncate(fd, sizeof(StatusBlock)) == 0) {
+        void *p = mmap(NULL, sizeof(StatusBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            status_block = p;
+            memset(status_block, 0, sizeof(StatusBlock));
+            status_block->magic = STATUS_MAGIC;
+            status_block->version = STATUS_VERSION;
+        }
+    }
+    close(fd);
 }
 
-static void write_focused_workspace_file(int ws_index) {
-    const char *home = getenv("HOME");
-    if (!home) return;
-    ensure_wm_dir();
-    char path[PATH_MAX];
-    snprintf(path, sizeof(path), "%s/.wm/focused.workspace", home);
+static void write_text_file(const char *path, const char *text) {
+    if (!path[0]) return;
     FILE *f = fopen(path, "w");
     if (!f) return;
-    fprintf(f, "%d\n", ws_index + 1);
+    fputs(text, f);
     fclose(f);
 }
 
-static void write_occupied_workspace_file(void) {
-    const char *home = getenv("HOME");
-    if (!home) return;
-    ensure_wm_dir();
-    char path[PATH_MAX];
-    snprintf(path, sizeof(path), "%s/.wm/occupied.workspace", home);
-    FILE *f = fopen(path, "w");
-    if (!f) return;
+static void export_state(void) {
+    unsigned int mask = 0;
+    for (int w = 0; w < MAX_WORKSPACES; ++w)
+        if (workspaces[w].count > 0) mask |= 1u << w;
 
-    int first = 1;
-    for (int w = 0; w < MAX_WORKSPACES; ++w) {
-        for (Client *c = clients; c; c = c->next) {
-            if (c->workspace == w) {
-                if (!first) fprintf(f, ",");
-                fprintf(f, "%d", w + 1);
-                first = 0;
-                break;
-            }
-        }
+    if (current_workspace != exported_focused) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%d\n", current_workspace + 1);
+        write_text_file(focused_path, buf);
+        exported_focused = current_workspace;
     }
-    fprintf(f, "\n");
-    fclose(f);
+
+    if ((int)mask != exported_occupied) {
+        char buf[4 * MAX_WORKSPACES + 2];
+        int len = 0;
+        for (int w = 0; w < MAX_WORKSPACES; ++w)
+            if (mask & (1u << w)) len += snprintf(buf + len, sizeof(buf) - len, len ? ",%d" : "%d", w + 1);
+        snprintf(buf + len, sizeof(buf) - len, "\n");
+        write_text_file(occupied_path, buf);
+        exported_occupied = (int)mask;
+    }
+
+    if (status_block) {
+        StatusBlock *b = status_block;
+        int changed = b->focused_ws != current_workspace + 1 || b->occupied_mask != mask;
+        for (int w = 0; !changed && w < MAX_WORKSPACES; ++w)
+            changed = b->nclients[w] != (uint32_t)workspaces[w].count;
+        if (!changed) return;
+        /* seqlock: readers retry while seq is odd or moved under them */
+        __atomic_store_n(&b->seq, b->seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        b->focused_ws = current_workspace + 1;
+        b->occupied_mask = mask;
+        for (int w = 0; w < MAX_WORKSPACES; ++w) b->nclients[w] = (uint32_t)workspaces[w].count;
+        __atomic_store_n(&b->seq, b->seq + 1, __ATOMIC_RELEASE);
+    }
+}
+
+/* --- window map --- */
+static size_t winmap_hash(Window w, size_t cap) {
+    /* fibonacci hashing; xids are mostly sequential in the low bits */
+    return (size_t)(((uint64_t)w * 0x9E3779B97F4A7C15ULL) >> 32) & (cap - 1);
+}
+
+static void winmap_put(WinMap *m, Window w, Client *c);
+
+static void winmap_grow(WinMap *m) {
+    size_t ncap = m->cap ? m->cap * 2 : WINMAP_MIN_CAP;
+    WinSlot *old = m->slots;
+    size_t ocap = m->cap;
+    WinSlot *ns = calloc(ncap, sizeof(WinSlot));
+    if (!ns) die("out of memory");
+    m->slots = ns;
+    m->cap = ncap;
+    m->len = 0;
+    for (size_t i = 0; i < ocap; ++i)
+        if (old[i].win) winmap_put(m, old[i].win, old[i].c);
+    free(old);
+}
+
+static Client *winmap_get(const WinMap *m, Window w) {
+    if (!m->cap || !w) return NULL;
+    for (size_t i = winmap_hash(w, m->cap); m->slots[i].win; i = (i + 1) & (m->cap - 1))
+        if (m->slots[i].win == w) return m->slots[i].c;
+    return NULL;
+}
+
+static void winmap_put(WinMap *m, Window w, Client *c) {
+    if (!w) return;
+    if ((m->len + 1) * 2 > m->cap) winmap_grow(m);
+    size_t i = winmap_hash(w, m->cap);
+    while (m->slots[i].win && m->slots[i].win != w) i = (i + 1) & (m->cap - 1);
+    if (!m->slots[i].win) ++m->len;
+    m->slots[i].win = w;
+    m->slots[i].c = c;
+}
+
+/* remove slot i and shift the following probe run back into the hole */
+static void winmap_del_slot(WinMap *m, size_t i) {
+    size_t mask = m->cap - 1;
+    size_t j = i;
+    m->slots[i].win = 0;
+    m->slots[i].c = NULL;
+    --m->len;
+    while (1) {
+        j = (j + 1) & mask;
+        if (!m->slots[j].win) return;
+        size_t home = winmap_hash(m->slots[j].win, m->cap);
+        /* keep slot j where it is if its home lies cyclically in (i, j] */
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j)) continue;
+        m->slots[i] = m->slots[j];
+        m->slots[j].win = 0;
+        m->slots[j].c = NULL;
+        i = j;
+    }
+}
+
+static void winmap_del(WinMap *m, Window w) {
+    if (!m->cap || !w) return;
+    for (size_t i = winmap_hash(w, m->cap); m->slots[i].win; i = (i + 1) & (m->cap - 1)) {
+        if (m->slots[i].win == w) { winmap_del_slot(m, i); return; }
+    }
+}
+
+/* drop every entry resolving to c (used when a client goes away) */
+static void winmap_del_client(WinMap *m, Client *c) {
+    if (!m->len) return;
+    for (size_t i = 0; i < m->cap; ) {
+        if (m->slots[i].win && m->slots[i].c == c) winmap_del_slot(m, i); /* re-check i */
+        else ++i;
+    }
+}
+
+static void winmap_clear(WinMap *m) {
+    if (!m->len) return;
+    memset(m->slots, 0, m->cap * sizeof(WinSlot));
+    m->len = 0;
 }
 
 /* --- client list helpers --- */
 static Client *find_client(Window w) {
-    for (Client *c = clients; c; c = c->next)
-        if (c->win == w) return c;
-    return NULL;
+    return winmap_get(&client_index, w);
 }
 
-static Client *find_toplevel_client_from_window(Window w) {
-    if (!w) return NULL;
+/* resolve w to its toplevel client using only what we already know */
+static Client *find_cached_toplevel(Window w) {
     Client *c = find_client(w);
+    return c ? c : winmap_get(&ancestry, w);
+}
+
+static Client *find_toplevel_client_from_window(Window w) {
+    if (!w || w == root) return NULL;
+    Client *c = find_cached_toplevel(w);
     if (c) return c;
 
+    /* cache miss: walk up, remembering the chain so the next lookup is local */
+    Window chain[32];
+    unsigned int depth = 0;
     Window root_ret, parent, *children = NULL;
     unsigned int nchildren = 0;
     Window cur = w;
     while (1) {
-        if (!XQueryTree(dpy, cur, &root_ret, &parent, &children, &nchildren)) break;
+        if (depth < sizeof(chain) / sizeof(chain[0])) chain[depth++] = cur;
+        int ok = XQueryTree(dpy, cur, &root_ret, &parent, &children, &nchildren);
+        stat_sync();
+        if (!ok) break;
         if (children) { XFree(children); children = NULL; }
         if (parent == 0 || parent == root) break;
-        c = find_client(parent);
-        if (c) return c;
+        c = find_cached_toplevel(parent);
+        if (c) {
+            for (unsigned int i = 0; i < depth; ++i) winmap_put(&ancestry, chain[i], c);
+            return c;
+        }
         cur = parent;
     }
     return NULL;
 }
 
+/* new clients go first in their workspace, like in the global list */
+static void ws_insert_after(Workspace *ws, Client *after, Client *c) {
+    c->ws_prev = after;
+    c->ws_next = after ? after->ws_next : ws->head;
+    if (c->ws_next) c->ws_next->ws_prev = c;
+    if (after) after->ws_next = c;
+    else ws->head = c;
+}
+
+static void ws_unlink(Workspace *ws, Client *c) {
+    if (c->ws_prev) c->ws_prev->ws_next = c->ws_next;
+    else ws->head = c->ws_next;
+    if (c->ws_next) c->ws_next->ws_prev = c->ws_prev;
+    c->ws_next = c->ws_prev = NULL;
+}
+
+/* list position of c on its workspace, which is what layouts index by */
+static int ws_index(const Workspace *ws, const Client *c) {
+    int i = 0;
+    for (const Client *p = ws->head; p && p != c; p = p->ws_next) ++i;
+    return i;
+}
+
+/* --- most recently used ring ---
+ * circular, per workspace, ws->mru at the front. a window that was never
+ * focused joins at the back; focusing one moves it to the front, except
+ * while alt-tab is cycling, so each step is just a pointer hop.
+ */
+static void mru_unlink(Workspace *ws, Client *c) {
+    if (!c->mru_next) return;
+    if (c->mru_next == c) {
+        ws->mru = NULL;
+    } else {
+        c->mru_prev->mru_next = c->mru_next;
+        c->mru_next->mru_prev = c->mru_prev;
+        if (ws->mru == c) ws->mru = c->mru_next;
+    }
+    c->mru_next = c->mru_prev = NULL;
+}
+
+static void mru_insert(Workspace *ws, Client *c, int front) {
+    Client *h = ws->mru;
+    if (!h) {
+        c->mru_next = c->mru_prev = ws->mru = c;
+        return;
+    }
+    /* just before the front is the back of the ring */
+    c->mru_next = h;
+    c->mru_prev = h->mru_prev;
+    h->mru_prev->mru_next = c;
+    h->mru_prev = c;
+    if (front) ws->mru = c;
+}
+
+static void mru_touch(Client *c) {
+    if (!c || c->workspace < 0 || cycling) return;
+    Workspace *ws = &workspaces[c->workspace];
+    if (ws->mru == c) return;
+    mru_unlink(ws, c);
+    mru_insert(ws, c, 1);
+}
+
+static void ws_attach(Client *c) {
+    if (c->workspace < 0) return;
+    Workspace *ws = &workspaces[c->workspace];
+    ws_insert_after(ws, NULL, c);
+    mru_insert(ws, c, 0);
+    ++ws->count;
+    ws->edges.valid = 0;
+    /* the new head splits the focused tile, or the old head's */
+    int at = ws->count > 1 ? 1 : 0;
+    if (focused && focused != c && focused->workspace == c->workspace) at = ws_index(ws, focused);
+    layout_insert(&ws->lstate, 0, at);
+}
+
+static void ws_detach(Client *c) {
+    if (c->workspace < 0) return;
+    Workspace *ws = &workspaces[c->workspace];
+    int pos = ws_index(ws, c);
+    ws_unlink(ws, c);
+    mru_unlink(ws, c);
+    --ws->count;
+    ws->edges.valid = 0;
+    layout_remove(&ws->lstate, pos);
+}
+
 static void add_client_to_list(Client *c) {
+    winmap_put(&client_index, c->win, c);
+    ws_attach(c);
     c->next = clients;
     c->prev = NULL;
     if (clients) clients->prev = c;
     clients = c;
 }
 
+static void set_client_workspace(Client *c, int ws) {
+    ws_detach(c);
+    c->workspace = ws;
+    ws_attach(c);
+}
+
 static void remove_client_from_list(Client *c) {
     if (!c) return;
+    winmap_del(&client_index, c->win);
+    winmap_del_client(&ancestry, c);
+    ws_detach(c);
     if (c->prev) c->prev->next = c->next;
     if (c->next) c->next->prev = c->prev;
     if (clients == c) clients = c->next;
 }
 
 /* --- geometry helpers --- */
-static void clamp_size(unsigned int *w, unsigned int *h) {
-    int sw = DisplayWidth(dpy, screen_num);
-    int sh = DisplayHeight(dpy, screen_num);
-    unsigned int maxw = (unsigned int)(sw * 0.95);
-    unsigned int maxh = (unsigned int)(sh * 0.95);
-    if (*w < MIN_WIN_W) *w = MIN_WIN_W;
-    if (*h < MIN_WIN_H) *h = MIN_WIN_H;
-    if (*w > maxw) *w = maxw;
-    if (*h > maxh) *h = maxh;
+static int ws_visible(int ws) {
+    return ws >= 0 && ws < MAX_WORKSPACES && ws_output[ws] >= 0;
+}
+
+/* the output ws is shown on; hidden workspaces belong to the current one */
+static Output *ws_out(int ws) {
+    return &outputs[ws_visible(ws) ? ws_output[ws] : current_output];
+}
+
+static int output_at(int x, int y) {
+    for (int i = 0; i < noutputs; ++i) {
+        const Output *o = &outputs[i];
+        if (x >= o->x && x < o->x + o->w && y >= o->y && y < o->y + o->h) return i;
+    }
+    return current_output;
+}
+
+static void clamp_size(int ws, unsigned int *w, unsigned int *h) {
+    const WorkArea *wa = &ws_out(ws)->wa;
+    layout_clamp(w, h, wa->max_w, wa->max_h);
+}
+
+/* --- timers ---
+ * deadlines for work the main loop does later. each slot is one fixed job;
+ * a single timerfd is kept armed for the earliest, so idle costs nothing.
+ */
+enum { TIMER_SYNC, TIMER_CONFIG, TIMER_COUNT };
+
+static void sync_expire(void);
+static void reload_config(void);
+
+static void (*const timer_jobs[TIMER_COUNT])(void) = {
+    [TIMER_SYNC] = sync_expire,
+    [TIMER_CONFIG] = reload_config,
+};
+static long long timer_due[TIMER_COUNT]; /* ms on the now_ms() clock, 0 = off */
+static long long timer_armed = 0;       /* what timer_fd is set to */
+static int timer_fd = -1;
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void timer_at(int id, long long due) {
+    timer_due[id] = due;
+}
+
+/* run the jobs that are due; each may schedule itself again */
+static void timers_run(void) {
+    long long t = now_ms();
+    for (int i = 0; i < TIMER_COUNT; ++i) {
+        if (!timer_due[i] || timer_due[i] > t) continue;
+        timer_due[i] = 0;
+        timer_jobs[i]();
+    }
+}
+
+/* point timer_fd at the earliest deadline, if that changed */
+static void timers_arm(void) {
+    long long next = 0;
+    for (int i = 0; i < TIMER_COUNT; ++i)
+        if (timer_due[i] && (!next || timer_due[i] < next)) next = timer_due[i];
+    if (timer_fd < 0 || next == timer_armed) return;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = next / 1000;
+    its.it_value.tv_nsec = (next % 1000) * 1000000;
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+    timer_armed = next;
+}
+
+/* --- _NET_WM_SYNC_REQUEST ---
+ * before resizing a client that takes part we send it a value, and an alarm
+ * on its counter tells us once it has painted that size. further resizes
+ * are held back until then (or SYNC_TIMEOUT_MS), and the newest geometry
+ * is sent when the alarm fires.
+ */
+static void sync_value_split(int64_t v, XSyncValue *out) {
+    XSyncIntsToValue(out, (unsigned int)(v & 0xffffffffu), (int)(v >> 32));
+}
+
+static void sync_attach(Client *c, XSyncCounter counter) {
+    if (!have_sync || counter == None) return;
+    XSyncAlarmAttributes aa;
+    aa.trigger.counter = counter;
+    aa.trigger.value_type = XSyncAbsolute;
+    aa.trigger.test_type = XSyncPositiveComparison;
+    sync_value_split(0, &aa.trigger.wait_value); /* fires at once and reports the counter */
+    sync_value_split(0, &aa.delta);
+    aa.events = True;
+    c->sync_alarm = XSyncCreateAlarm(dpy, XSyncCACounter | XSyncCAValueType | XSyncCAValue |
+                                          XSyncCATestType | XSyncCADelta | XSyncCAEvents, &aa);
+    c->sync_counter = counter;
+    winmap_put(&sync_alarms, c->sync_alarm, c);
+}
+
+static void sync_detach(Client *c) {
+    if (c->sync_counter == None) return;
+    if (c->sync_waiting) --sync_waiting;
+    winmap_del(&sync_alarms, c->sync_alarm);
+    XSyncDestroyAlarm(dpy, c->sync_alarm);
+    c->sync_counter = None;
+    c->sync_waiting = 0;
+}
+
+static void sync_request(Client *c) {
+    XSyncValue v;
+    sync_value_split(++c->sync_value, &v);
+
+    XSyncAlarmAttributes aa;
+    aa.trigger.wait_value = v;
+    XSyncChangeAlarm(dpy, c->sync_alarm, XSyncCAValue, &aa);
+
+    XEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = ClientMessage;
+    ev.xclient.window = c->win;
+    ev.xclient.message_type = ATOM_WM_PROTOCOLS;
+    ev.xclient.format = 32;
+    ev.xclient.data.l[0] = NET_WM_SYNC_REQUEST;
+    ev.xclient.data.l[1] = CurrentTime;
+    ev.xclient.data.l[2] = (long)XSyncValueLow32(v);
+    ev.xclient.data.l[3] = (long)XSyncValueHigh32(v);
+    XSendEvent(dpy, c->win, False, NoEventMask, &ev);
+
+    c->sync_waiting = 1;
+    c->sync_deadline = now_ms() + SYNC_TIMEOUT_MS;
+    ++sync_waiting;
+    /* deadlines only grow, so an armed timer is already early enough */
+    if (!timer_due[TIMER_SYNC]) timer_at(TIMER_SYNC, c->sync_deadline);
+}
+
+static void configure_client(Client *c);
+
+/* the client painted (or we gave up on it): send whatever is held back */
+static void sync_done(Client *c) {
+    if (!c->sync_waiting) return;
+    c->sync_waiting = 0;
+    --sync_waiting;
+    configure_client(c);
+}
+
+static void handle_sync_alarm(XEvent *ev) {
+    XSyncAlarmNotifyEvent *ae = (XSyncAlarmNotifyEvent *)ev;
+    Client *c = winmap_get(&sync_alarms, ae->alarm);
+    if (!c) return;
+    int64_t v = ((int64_t)XSyncValueHigh32(ae->counter_value) << 32) | XSyncValueLow32(ae->counter_value);
+    if (v < c->sync_value) return; /* an earlier trigger, not our latest request */
+    c->sync_value = v; /* never ask for a value the counter has already passed */
+    sync_done(c);
+}
+
+/* ms until the next client times out, -1 if none is waiting */
+static int sync_timeout(void) {
+    if (!sync_waiting) return -1;
+    long long next = -1, t = now_ms();
+    for (Client *c = clients; c; c = c->next)
+        if (c->sync_waiting && (next < 0 || c->sync_deadline < next)) next = c->sync_deadline;
+    if (next < 0) return -1;
+    return next <= t ? 0 : (int)(next - t);
+}
+
+static void sync_expire(void) {
+    if (!sync_waiting) return;
+    long long t = now_ms();
+    for (Client *c = clients; c; c = c->next)
+        if (c->sync_waiting && c->sync_deadline <= t) sync_done(c);
+    int left = sync_timeout();
+    timer_at(TIMER_SYNC, left < 0 ? 0 : now_ms() + left);
+}
+
+/* send c's geometry to the server, unless it already has exactly that */
+static void configure_client(Client *c) {
+    if (c->hidden && HIDE_OFFSCREEN) return; /* sent when shown again */
+    if (c->configured && c->ax == c->x && c->ay == c->y && c->aw == c->w && c->ah == c->h) return;
+    if (c->workspace >= 0) workspaces[c->workspace].edges.valid = 0;
+    if (c->sync_counter != None && (!c->configured || c->aw != c->w || c->ah != c->h)) {
+        if (c->sync_waiting) return; /* sent from sync_done() */
+        sync_request(c);
+    }
+    c->ax = c->x; c->ay = c->y;
+    c->aw = c->w; c->ah = c->h;
+    c->configured = 1;
+    XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
+}
+
+/* --- visibility ---
+ * windows on hidden workspaces are unmapped, or with HIDE_OFFSCREEN kept
+ * mapped and parked left of the screen so clients keep their surfaces.
+ * both only send what changes the server's state.
+ */
+static void map_client(Client *c) {
+    if (c->amapped) return;
+    XMapWindow(dpy, c->win);
+    c->amapped = 1;
+}
+
+static void show_client(Client *c) {
+    map_client(c);
+    if (!c->hidden) return;
+    c->hidden = 0;
+    if (HIDE_OFFSCREEN) configure_client(c); /* back from off-screen */
+}
+
+static void hide_client(Client *c) {
+    if (c->hidden) return;
+    c->hidden = 1;
+    if (HIDE_OFFSCREEN) {
+        int x = -2 * (int)(c->aw + 2 * c->abw);
+        if (x > -1) x = -1;
+        if (c->ax != x) XMoveWindow(dpy, c->win, x, c->ay);
+        c->ax = x;
+    } else if (c->amapped) {
+        XUnmapWindow(dpy, c->win);
+        c->amapped = 0;
+        ++c->unmaps_expected;
+    }
 }
 
 /* --- dock helpers --- */
@@ -308,8 +1095,43 @@ static void clamp_size(unsigned int *w, unsigned int *h) {
 /* Read window type and full strut partial (12 cardinals).
  * Fills extended strut fields; sets c->is_dock if appropriate.
  */
-static void get_window_type_and_strut(Window w, Client *c) {
-    if (!c) return;
+static void query_props(Window w, WindowQuery *q) {
+    memset(&q->type, 0, sizeof(q->type));
+    memset(&q->strut, 0, sizeof(q->strut));
+    if (NET_WM_WINDOW_TYPE != None)
+        q->type = xcb_get_property(xc, 0, w, NET_WM_WINDOW_TYPE, XCB_ATOM_ATOM, 0, 64);
+    if (NET_WM_STRUT_PARTIAL != None)
+        q->strut = xcb_get_property(xc, 0, w, NET_WM_STRUT_PARTIAL, XCB_ATOM_CARDINAL, 0, 12);
+}
+
+static void query_window(Window w, WindowQuery *q) {
+    q->attr = xcb_get_window_attributes(xc, w);
+    q->geom = xcb_get_geometry(xc, w);
+    query_props(w, q);
+    memset(&q->protocols, 0, sizeof(q->protocols));
+    memset(&q->sync_counter, 0, sizeof(q->sync_counter));
+    if (have_sync) {
+        q->protocols = xcb_get_property(xc, 0, w, ATOM_WM_PROTOCOLS, XCB_ATOM_ATOM, 0, 32);
+        q->sync_counter = xcb_get_property(xc, 0, w, NET_WM_SYNC_REQUEST_COUNTER, XCB_ATOM_CARDINAL, 0, 1);
+    }
+}
+
+/* fetch a property reply; NULL if it is missing or not 32-bit */
+static xcb_get_property_reply_t *property_reply(xcb_get_property_cookie_t ck, const uint32_t **vals, int *n) {
+    if (!ck.sequence) return NULL;
+    xcb_generic_error_t *err = NULL;
+    stat_reply(ck.sequence);
+    xcb_get_property_reply_t *r = xcb_get_property_reply(xc, ck, &err);
+    free(err);
+    if (r && r->format != 32) { free(r); r = NULL; }
+    if (!r) return NULL;
+    *vals = xcb_get_property_value(r);
+    *n = xcb_get_property_value_length(r) / 4;
+    return r;
+}
+
+/* _NET_WM_WINDOW_TYPE and _NET_WM_STRUT_PARTIAL replies -> dock flag and struts */
+static void collect_props(WindowQuery *q, Client *c) {
     c->is_dock = 0;
     c->strut_left = c->strut_right = c->strut_top = c->strut_bottom = 0;
     c->strut_left_start_y = c->strut_left_end_y = 0;
@@ -317,63 +1139,219 @@ static void get_window_type_and_strut(Window w, Client *c) {
     c->strut_top_start_x = c->strut_top_end_x = 0;
     c->strut_bottom_start_x = c->strut_bottom_end_x = 0;
 
-    Atom actual_type = None;
-    int actual_format = 0;
-    unsigned long nitems = 0, bytes_after = 0;
-    unsigned char *prop = NULL;
-
-    /* read _NET_WM_WINDOW_TYPE */
-    if (NET_WM_WINDOW_TYPE != None) {
-        if (XGetWindowProperty(dpy, w, NET_WM_WINDOW_TYPE, 0, 64, False,
-                               XA_ATOM, &actual_type, &actual_format,
-                               &nitems, &bytes_after, &prop) == Success && prop) {
-            Atom *atoms = (Atom *)prop;
-            for (unsigned long i = 0; i < nitems; ++i) {
-                if (atoms[i] == NET_WM_WINDOW_TYPE_DOCK) { c->is_dock = 1; break; }
-            }
-            XFree(prop); prop = NULL;
+    const uint32_t *vals;
+    int n;
+    xcb_get_property_reply_t *r;
+
+    if ((r = property_reply(q->type, &vals, &n))) {
+        for (int i = 0; i < n; ++i) {
+            if (vals[i] == NET_WM_WINDOW_TYPE_DOCK) { c->is_dock = 1; break; }
         }
+        free(r);
     }
 
-    /* read _NET_WM_STRUT_PARTIAL (12 cardinals) */
-    if (NET_WM_STRUT_PARTIAL != None) {
-        if (XGetWindowProperty(dpy, w, NET_WM_STRUT_PARTIAL, 0, 12, False,
-                               XA_CARDINAL, &actual_type, &actual_format,
-                               &nitems, &bytes_after, &prop) == Success && prop) {
-            unsigned long *vals = (unsigned long *)prop;
-            if (nitems >= 4) {
-                c->strut_left   = vals[0];
-                c->strut_right  = vals[1];
-                c->strut_top    = vals[2];
-                c->strut_bottom = vals[3];
-            }
-            if (nitems >= 12) {
-                c->strut_left_start_y   = vals[4];
-                c->strut_left_end_y     = vals[5];
-                c->strut_right_start_y  = vals[6];
-                c->strut_right_end_y    = vals[7];
-                c->strut_top_start_x    = vals[8];
-                c->strut_top_end_x      = vals[9];
-                c->strut_bottom_start_x = vals[10];
-                c->strut_bottom_end_x   = vals[11];
-                /* if any non-zero, treat as dock */
-                if (c->strut_left || c->strut_right || c->strut_top || c->strut_bottom) c->is_dock = 1;
-            }
-            XFree(prop); prop = NULL;
+    /* 12 cardinals */
+    if ((r = property_reply(q->strut, &vals, &n))) {
+        if (n >= 4) {
+            c->strut_left   = vals[0];
+            c->strut_right  = vals[1];
+            c->strut_top    = vals[2];
+            c->strut_bottom = vals[3];
         }
+        if (n >= 12) {
+            c->strut_left_start_y   = vals[4];
+            c->strut_left_end_y     = vals[5];
+            c->strut_right_start_y  = vals[6];
+            c->strut_right_end_y    = vals[7];
+            c->strut_top_start_x    = vals[8];
+            c->strut_top_end_x      = vals[9];
+            c->strut_bottom_start_x = vals[10];
+            c->strut_bottom_end_x   = vals[11];
+            /* if any non-zero, treat as dock */
+            if (c->strut_left || c->strut_right || c->strut_top || c->strut_bottom) c->is_dock = 1;
+        }
+        free(r);
     }
 }
 
-/* Compute reserved areas from all docks (keep existing semantics: max per side) */
-static void update_global_struts(void) {
-    reserved_top = reserved_bottom = reserved_left = reserved_right = 0;
+/* collect everything query_window() asked for. returns 0 if the window is
+ * gone; all replies are consumed either way. */
+static int collect_window(WindowQuery *q, Client *c) {
+    xcb_generic_error_t *err = NULL;
+    stat_reply(q->attr.sequence);
+    xcb_get_window_attributes_reply_t *attr = xcb_get_window_attributes_reply(xc, q->attr, &err);
+    free(err); err = NULL;
+    stat_reply(q->geom.sequence);
+    xcb_get_geometry_reply_t *geom = xcb_get_geometry_reply(xc, q->geom, &err);
+    free(err);
+    collect_props(q, c);
+
+    /* sync needs both the protocol and its counter */
+    const uint32_t *vals;
+    int n, speaks_sync = 0;
+    xcb_get_property_reply_t *r;
+    q->counter = None;
+    if ((r = property_reply(q->protocols, &vals, &n))) {
+        for (int i = 0; i < n; ++i) if (vals[i] == NET_WM_SYNC_REQUEST) speaks_sync = 1;
+        free(r);
+    }
+    if ((r = property_reply(q->sync_counter, &vals, &n))) {
+        if (speaks_sync && n >= 1) q->counter = vals[0];
+        free(r);
+    }
+
+    int ok = attr != NULL;
+    q->override_redirect = attr ? attr->override_redirect : 0;
+    q->viewable = attr ? attr->map_state == XCB_MAP_STATE_VIEWABLE : 0;
+    if (geom) {
+        c->w = geom->width;
+        c->h = geom->height;
+    } else {
+        c->w = 400;
+        c->h = 300;
+    }
+    free(attr);
+    free(geom);
+    return ok;
+}
+
+static void get_window_type_and_strut(Window w, Client *c) {
+    if (!c) return;
+    WindowQuery q;
+    query_props(w, &q);
+    collect_props(&q, c);
+}
+
+/* --- reserved regions ---
+ * every strut is a rect of the root window: its partial range along the
+ * edge (the whole edge without one) times its depth. an output reserves,
+ * per edge, as far as the rects anchored on that edge reach into it.
+ */
+enum { EDGE_TOP, EDGE_BOTTOM, EDGE_LEFT, EDGE_RIGHT };
+
+typedef struct {
+    Rect r;
+    int edge;
+} StrutRect;
+
+/* [start, end] of a partial strut as offset and length along an edge */
+static int strut_range(unsigned long start, unsigned long end, int edge_len, int *len) {
+    if (end <= start) {
+        *len = edge_len;
+        return 0;
+    }
+    *len = (int)(end - start + 1);
+    return (int)start;
+}
+
+static int strut_rects(const Client *c, StrutRect *out) {
+    int n = 0, pos, len;
+    if (c->strut_top) {
+        pos = strut_range(c->strut_top_start_x, c->strut_top_end_x, screen_w, &len);
+        out[n++] = (StrutRect){ { pos, 0, len, (int)c->strut_top }, EDGE_TOP };
+    }
+    if (c->strut_bottom) {
+        pos = strut_range(c->strut_bottom_start_x, c->strut_bottom_end_x, screen_w, &len);
+        out[n++] = (StrutRect){ { pos, screen_h - (int)c->strut_bottom, len, (int)c->strut_bottom }, EDGE_BOTTOM };
+    }
+    if (c->strut_left) {
+        pos = strut_range(c->strut_left_start_y, c->strut_left_end_y, screen_h, &len);
+        out[n++] = (StrutRect){ { 0, pos, (int)c->strut_left, len }, EDGE_LEFT };
+    }
+    if (c->strut_right) {
+        pos = strut_range(c->strut_right_start_y, c->strut_right_end_y, screen_h, &len);
+        out[n++] = (StrutRect){ { screen_w - (int)c->strut_right, pos, (int)c->strut_right, len }, EDGE_RIGHT };
+    }
+    return n;
+}
+
+static void reserve(int *res, int amount, int limit) {
+    if (amount > limit) amount = limit;
+    if (amount > *res) *res = amount;
+}
+
+/* widen o's reserve on the rect's edge to cover the part reaching into o */
+static void reserve_rect(Output *o, const StrutRect *s) {
+    const Rect *r = &s->r;
+    int across_x = r->x < o->x + o->w && r->x + r->w > o->x;
+    int across_y = r->y < o->y + o->h && r->y + r->h > o->y;
+    switch (s->edge) {
+        case EDGE_TOP:    if (across_x) reserve(&o->reserve_top, r->y + r->h - o->y, o->h); break;
+        case EDGE_BOTTOM: if (across_x) reserve(&o->reserve_bottom, o->y + o->h - r->y, o->h); break;
+        case EDGE_LEFT:   if (across_y) reserve(&o->reserve_left, r->x + r->w - o->x, o->w); break;
+        case EDGE_RIGHT:  if (across_y) reserve(&o->reserve_right, o->x + o->w - r->x, o->w); break;
+    }
+}
+
+/* usable rect and size limits of every output; only changes with the struts
+ * or the outputs, so everything else reads it from here. returns a mask of
+ * the outputs whose work area changed. */
+static unsigned int update_work_areas(void) {
+    unsigned int changed = 0;
+    for (int i = 0; i < noutputs; ++i) {
+        Output *o = &outputs[i];
+        WorkArea *wa = &o->wa, was = o->wa;
+        wa->x = o->x + o->reserve_left;
+        wa->y = o->y + o->reserve_top;
+        wa->w = o->w - o->reserve_left - o->reserve_right;
+        wa->h = o->h - o->reserve_top - o->reserve_bottom;
+        if (wa->w < 1) wa->w = 1;
+        if (wa->h < 1) wa->h = 1;
+        layout_clamp_limits(o->w, o->h, &wa->max_w, &wa->max_h);
+        if (memcmp(wa, &was, sizeof(was)) != 0) changed |= 1u << i;
+    }
+    if (changed) pending.workarea = 1;
+    return changed;
+}
+
+/* _NET_WORKAREA: per desktop, the work area of the output showing it
+ * (hidden ones report the primary output); only sent when it changes */
+static void publish_workarea(void) {
+    static long published[4 * MAX_WORKSPACES];
+    if (NET_WORKAREA == None) return;
+    long wa[4 * MAX_WORKSPACES];
+    for (int ws = 0; ws < MAX_WORKSPACES; ++ws) {
+        const WorkArea *a = &outputs[ws_visible(ws) ? ws_output[ws] : 0].wa;
+        wa[4 * ws] = a->x;
+        wa[4 * ws + 1] = a->y;
+        wa[4 * ws + 2] = a->w;
+        wa[4 * ws + 3] = a->h;
+    }
+    if (memcmp(wa, published, sizeof(wa)) == 0) return;
+    memcpy(published, wa, sizeof(wa));
+    XChangeProperty(dpy, root, NET_WORKAREA, XA_CARDINAL, 32, PropModeReplace, (unsigned char *)wa, 4 * MAX_WORKSPACES);
+}
+
+/* Compute reserved areas from all docks (keep existing semantics: max per side).
+ * returns the outputs whose work area changed, see update_struts().
+ */
+static unsigned int update_global_struts(void) {
+    for (int i = 0; i < noutputs; ++i) {
+        Output *o = &outputs[i];
+        o->reserve_top = o->reserve_bottom = o->reserve_left = o->reserve_right = 0;
+    }
     for (Client *c = clients; c; c = c->next) {
         if (!c->is_dock) continue;
-        if ((int)c->strut_top > reserved_top) reserved_top = (int)c->strut_top;
-        if ((int)c->strut_bottom > reserved_bottom) reserved_bottom = (int)c->strut_bottom;
-        if ((int)c->strut_left > reserved_left) reserved_left = (int)c->strut_left;
-        if ((int)c->strut_right > reserved_right) reserved_right = (int)c->strut_right;
+        StrutRect r[4];
+        int n = strut_rects(c, r);
+        for (int i = 0; i < noutputs; ++i)
+            for (int k = 0; k < n; ++k) reserve_rect(&outputs[i], &r[k]);
     }
+    return update_work_areas();
+}
+
+/* a dock appeared, went away or changed its struts: only the workspaces on
+ * outputs whose work area actually moved are laid out again */
+static void update_struts(void) {
+    unsigned int changed = update_global_struts();
+    if (!changed) return;
+    for (Client *c = clients; c; c = c->next)
+        if (c->is_dock) apply_dock_geometry(c);
+    for (int i = 0; i < noutputs; ++i)
+        if (changed & (1u << i)) queue_arrange(outputs[i].workspace);
+    /* hidden workspaces get laid out for whichever output shows them next */
+    for (int ws = 0; ws < MAX_WORKSPACES; ++ws)
+        if (!ws_visible(ws)) workspaces[ws].dirty = 1;
 }
 
 /* set _NET_WM_STATE _ABOVE for compositors */
@@ -383,14 +1361,129 @@ static void set_dock_above_property(Window w) {
     XChangeProperty(dpy, w, NET_WM_STATE, XA_ATOM, 32, PropModeReplace, (unsigned char *)atoms, 1);
 }
 
-/* raise all docks last so they remain on top */
-static void restack_docks(void) {
-    for (Client *c = clients; c; c = c->next) {
-        if (c->is_dock) {
-            XMapWindow(dpy, c->win);    /* ensure mapped */
-            XRaiseWindow(dpy, c->win);  /* raise dock last */
+/* --- stacking ---
+ * stack.applied is the order the server has our windows in, top first. the
+ * wanted order is docks, then the focused window, then everything else by
+ * when it was last raised. restack() keeps the longest run of windows that
+ * are already in the right relative order and moves only the rest, so one
+ * raise costs one request however many windows are managed.
+ */
+static struct {
+    Client **applied, **want;
+    int *tail, *prev, *keep;   /* longest increasing run scratch */
+    int n, cap;
+    unsigned long clock;
+} stack;
+
+static int stack_reserve(int n) {
+    if (n <= stack.cap) return 1;
+    int cap = stack.cap ? stack.cap : 32;
+    while (cap < n) cap *= 2;
+    Client **a = realloc(stack.applied, cap * sizeof(Client *));
+    if (a) stack.applied = a;
+    Client **w = realloc(stack.want, cap * sizeof(Client *));
+    if (w) stack.want = w;
+    int *t = realloc(stack.tail, cap * sizeof(int));
+    if (t) stack.tail = t;
+    int *p = realloc(stack.prev, cap * sizeof(int));
+    if (p) stack.prev = p;
+    int *k = realloc(stack.keep, cap * sizeof(int));
+    if (k) stack.keep = k;
+    if (!a || !w || !t || !p || !k) return 0;
+    stack.cap = cap;
+    return 1;
+}
+
+/* new windows are created on top of their siblings */
+static void stack_insert_top(Client *c) {
+    if (!stack_reserve(stack.n + 1)) die("out of memory");
+    memmove(stack.applied + 1, stack.applied, stack.n * sizeof(Client *));
+    stack.applied[0] = c;
+    ++stack.n;
+    c->stack_seq = ++stack.clock;
+    pending.restack = 1;
+}
+
+/* a destroyed window leaves the others in place */
+static void stack_remove(Client *c) {
+    for (int i = 0; i < stack.n; ++i) {
+        if (stack.applied[i] != c) continue;
+        memmove(stack.applied + i, stack.applied + i + 1, (stack.n - i - 1) * sizeof(Client *));
+        --stack.n;
+        return;
+    }
+}
+
+static void raise_client(Client *c) {
+    if (!c || c->stack_seq == stack.clock) return; /* already the last raised */
+    c->stack_seq = ++stack.clock;
+    pending.restack = 1;
+}
+
+static int stack_layer(const Client *c) {
+    if (c->is_dock) return 2;
+    /* the focus rides on top, but not while alt-tab is still stepping */
+    if (c == focused && c->workspace == current_workspace && !cycling) return 1;
+    return 0;
+}
+
+static int stack_cmp(const void *pa, const void *pb) {
+    const Client *a = *(Client *const *)pa, *b = *(Client *const *)pb;
+    int la = stack_layer(a), lb = stack_layer(b);
+    if (la != lb) return lb - la;
+    return (a->stack_seq < b->stack_seq) - (a->stack_seq > b->stack_seq);
+}
+
+/* send want[from..to] as one restack below want[from - 1], or on top */
+static void restack_run(int from, int to) {
+    Window wins[64];
+    int n = 0;
+    if (from == 0) XRaiseWindow(dpy, stack.want[0]->win);
+    else wins[n++] = stack.want[from - 1]->win;
+    for (int i = from; i <= to; ++i) {
+        wins[n++] = stack.want[i]->win;
+        if (n == (int)(sizeof(wins) / sizeof(wins[0]))) {
+            XRestackWindows(dpy, wins, n);
+            wins[0] = wins[n - 1];
+            n = 1;
         }
     }
+    if (n > 1) XRestackWindows(dpy, wins, n);
+}
+
+static void restack(void) {
+    int n = stack.n;
+    if (n == 0) return;
+    memcpy(stack.want, stack.applied, n * sizeof(Client *));
+    qsort(stack.want, n, sizeof(Client *), stack_cmp);
+
+    /* longest run of want[] whose applied positions increase stays put */
+    for (int i = 0; i < n; ++i) stack.applied[i]->stack_pos = i;
+    int len = 0;
+    for (int i = 0; i < n; ++i) {
+        int p = stack.want[i]->stack_pos;
+        int lo = 0, hi = len;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (stack.want[stack.tail[mid]]->stack_pos < p) lo = mid + 1; else hi = mid;
+        }
+        stack.prev[i] = lo ? stack.tail[lo - 1] : -1;
+        stack.tail[lo] = i;
+        if (lo == len) ++len;
+        stack.keep[i] = 0;
+    }
+    if (len == n) return; /* already in order */
+    for (int i = stack.tail[len - 1]; i >= 0; i = stack.prev[i]) stack.keep[i] = 1;
+
+    /* everything else goes directly below its predecessor, top down */
+    for (int i = 0; i < n; ++i) {
+        if (stack.keep[i]) continue;
+        int j = i;
+        while (j + 1 < n && !stack.keep[j + 1]) ++j;
+        restack_run(i, j);
+        i = j;
+    }
+    memcpy(stack.applied, stack.want, n * sizeof(Client *));
 }
 
 /* Enforce the dock geometry derived from struts.
@@ -400,8 +1493,10 @@ static void restack_docks(void) {
 static void apply_dock_geometry(Client *c) {
     if (!c || !c->is_dock) return;
 
-    int sw = DisplayWidth(dpy, screen_num);
-    int sh = DisplayHeight(dpy, screen_num);
+    int sw = screen_w;
+    int sh = screen_h;
+    /* docks without a partial range span the output they sit on */
+    const Output *o = &outputs[output_at(c->x + (int)c->w / 2, c->y + (int)c->h / 2)];
 
     int new_x = 0, new_y = 0, new_w = (int)c->w, new_h = (int)c->h;
 
@@ -413,8 +1508,8 @@ static void apply_dock_geometry(Client *c) {
             new_w = (int)(c->strut_top_end_x - c->strut_top_start_x + 1);
         } else {
             /* fallback span full width minus left/right reserves */
-            new_x = 0;
-            new_w = sw - reserved_left - reserved_right;
+            new_x = o->wa.x;
+            new_w = o->wa.w;
         }
         new_h = (int)c->strut_top;
     } else if (c->strut_bottom > 0) {
@@ -424,8 +1519,8 @@ static void apply_dock_geometry(Client *c) {
             new_x = (int)c->strut_bottom_start_x;
             new_w = (int)(c->strut_bottom_end_x - c->strut_bottom_start_x + 1);
         } else {
-            new_x = 0;
-            new_w = sw - reserved_left - reserved_right;
+            new_x = o->wa.x;
+            new_w = o->wa.w;
         }
     } else if (c->strut_left > 0) {
         new_x = 0;
@@ -434,8 +1529,8 @@ static void apply_dock_geometry(Client *c) {
             new_y = (int)c->strut_left_start_y;
             new_h = (int)(c->strut_left_end_y - c->strut_left_start_y + 1);
         } else {
-            new_y = 0;
-            new_h = sh - reserved_top - reserved_bottom;
+            new_y = o->wa.y;
+            new_h = o->wa.h;
         }
     } else if (c->strut_right > 0) {
         new_w = (int)c->strut_right;
@@ -444,8 +1539,8 @@ static void apply_dock_geometry(Client *c) {
             new_y = (int)c->strut_right_start_y;
             new_h = (int)(c->strut_right_end_y - c->strut_right_start_y + 1);
         } else {
-            new_y = 0;
-            new_h = sh - reserved_top - reserved_bottom;
+            new_y = o->wa.y;
+            new_h = o->wa.h;
         }
     } else {
         /* Not a real strut; keep current geometry (but ensure mapped/global) */
@@ -469,88 +1564,160 @@ static void apply_dock_geometry(Client *c) {
     c->w = (unsigned int)new_w;
     c->h = (unsigned int)new_h;
 
-    XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
+    configure_client(c);
 }
 
 /* --- borders --- */
+/* send only the parts of a border that differ from what the server has */
+static void set_border(Client *c, unsigned int width, unsigned long col) {
+    if (!(c->border_set & BORDER_WIDTH) || c->abw != width) {
+        XSetWindowBorderWidth(dpy, c->win, width);
+        c->abw = width;
+        c->border_set |= BORDER_WIDTH;
+    }
+    /* the color of a zero-width border is invisible; leave it until it shows */
+    if (width && (!(c->border_set & BORDER_COLOR) || c->abcol != col)) {
+        XSetWindowBorder(dpy, c->win, col);
+        c->abcol = col;
+        c->border_set |= BORDER_COLOR;
+    }
+}
+
+static void draw_border(Client *c) {
+    if (!c || c->is_dock) return;
+    if (c == focused && c->workspace == current_workspace) set_border(c, border_focus_width, border_focus_col);
+    else set_border(c, border_unfocus_width, border_unfocus_col);
+}
+
+/* every managed window gets the unfocused border in manage(), so at most one
+ * window is ever drawn focused: only it and the new focus need redrawing. */
 static void update_borders(void) {
-    /* first, apply borders / raise focused normal windows */
-    for (Client *c = clients; c; c = c->next) {
-        if (c->is_dock) continue; /* skip docks for normal border logic */
+    Client *now = (focused && !focused->is_dock && focused->workspace == current_workspace) ? focused : NULL;
+    if (drawn_focus != now) {
+        Client *old = drawn_focus;
+        drawn_focus = now;
+        draw_border(old);
+    }
+    draw_border(now);
 
-        if (c->workspace != current_workspace) {
-            XSetWindowBorderWidth(dpy, c->win, 0);
-            continue;
-        }
-        if (focused && c == focused) {
-            XSetWindowBorderWidth(dpy, c->win, border_focus_width);
-            XSetWindowBorder(dpy, c->win, border_focus_col);
-            XRaiseWindow(dpy, c->win);
-        } else {
-            XSetWindowBorderWidth(dpy, c->win, border_unfocus_width);
-            XSetWindowBorder(dpy, c->win, border_unfocus_col);
+    /* the focused window comes to the top of the normal layer, once alt-tab
+     * has settled on one */
+    if (now && !cycling) raise_client(now);
+    pending.restack = 1;
+}
+
+/* --- deferred request helpers --- */
+static void queue_focus(Client *c) { if (c) pending.focus = c; }
+static void queue_borders(void) { pending.borders = 1; }
+static void queue_arrange(int ws) { if (ws >= 0 && ws < MAX_WORKSPACES) pending.arrange |= 1u << ws; }
+static void queue_status(void) { pending.status = 1; }
+
+static void flush_pending(void) {
+    /* geometry first so focus and stacking act on final positions */
+    for (int ws = 0; pending.arrange && ws < MAX_WORKSPACES; ++ws) {
+        if (!(pending.arrange & (1u << ws))) continue;
+        pending.arrange &= ~(1u << ws);
+        if (tag_mode[ws] == MODE_TILING) tile_workspace(ws);
+    }
+    if (pending.borders) {
+        pending.borders = 0;
+        update_borders();
+    }
+    if (pending.restack) {
+        pending.restack = 0;
+        restack();
+    }
+    if (pending.focus) {
+        if (pending.focus->workspace == current_workspace) {
+            XSetInputFocus(dpy, pending.focus->win, RevertToPointerRoot, CurrentTime);
+            mru_touch(pending.focus); /* every focus path ends here */
         }
+        pending.focus = NULL;
     }
-
-    /* now ensure docks are mapped + on top */
-    restack_docks();
+    if (pending.status) {
+        pending.status = 0;
+        export_state();
+    }
+    if (pending.workarea) {
+        pending.workarea = 0;
+        publish_workarea();
+    }
+    XFlush(dpy);
 }
 
 /* --- manage / unmanage --- */
+static void manage_queried(Window w, WindowQuery *q);
+
+/* a MapRequest for a window we still manage: it was withdrawn without us
+ * seeing the unmap, so map it again where it is instead of adding a twin */
+static void remap_client(Client *c) {
+    c->amapped = 0; /* the server's window is unmapped, whatever we last sent */
+    c->unmaps_expected = 0;
+    if (c->hidden && !HIDE_OFFSCREEN) return; /* shown with its workspace */
+    map_client(c);
+    queue_borders();
+}
+
 static void manage(Window w) {
-    XWindowAttributes wa;
-    if (!XGetWindowAttributes(dpy, w, &wa)) return;
     if (w == root) return;
+    Client *known = find_client(w);
+    if (known) { remap_client(known); return; }
+    WindowQuery q;
+    query_window(w, &q);
+    manage_queried(w, &q);
+}
 
-    Client *c = calloc(1, sizeof(Client));
-    if (!c) return;
+/* second half of manage(): the replies for w are outstanding in q */
+static void manage_queried(Window w, WindowQuery *q) {
+    Client *c = find_client(w) ? NULL : calloc(1, sizeof(Client));
+    if (!c) {
+        Client scratch;
+        collect_window(q, &scratch); /* drain the replies */
+        if (find_client(w)) remap_client(find_client(w));
+        return;
+    }
     c->win = w;
     c->workspace = current_workspace;
 
-    /* detect dock/panel + read strut (fills partials too) */
-    get_window_type_and_strut(w, c);
-
-    /* if override-redirect and not a dock -> ignore (like many tooltips) */
-    if (wa.override_redirect && !c->is_dock) {
+    /* window gone, or override-redirect and not a dock (tooltips and the like) */
+    if (!collect_window(q, c) || (q->override_redirect && !c->is_dock)) {
         free(c);
         return;
     }
+    c->amapped = q->viewable; /* adopted windows are often already mapped */
 
-    if (XGetWindowAttributes(dpy, w, &wa)) {
-        c->w = wa.width;
-        c->h = wa.height;
-    } else {
-        c->w = 400;
-        c->h = 300;
-    }
-
-    clamp_size(&c->w, &c->h);
+    clamp_size(c->workspace, &c->w, &c->h);
 
-    int sw = DisplayWidth(dpy, screen_num);
-    int sh = DisplayHeight(dpy, screen_num);
-    int cx = (sw - (int)c->w) / 2;
-    int cy = (sh - (int)c->h) / 2;
-    c->x = cx; c->y = cy;
+    /* centred on the output showing the current workspace */
+    const Output *o = ws_out(c->workspace);
+    c->x = o->x + (o->w - (int)c->w) / 2;
+    c->y = o->y + (o->h - (int)c->h) / 2;
 
-    XSetWindowBorderWidth(dpy, c->win, 0);
-    XSetWindowBorder(dpy, c->win, border_unfocus_col);
+    /* docks never get a border; update_borders() only redraws the focus */
+    set_border(c, c->is_dock ? 0 : border_unfocus_width, border_unfocus_col);
 
-    XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
+    /* docks are placed from their struts and tiled windows by the arrange
+     * queued below; only floating windows need the centred geometry now */
+    if (!c->is_dock && tag_mode[c->workspace] != MODE_TILING) configure_client(c);
 
     /* docks get minimal events to avoid focus on Enter/PointerMotion, but we do want PropertyChange */
     if (c->is_dock) {
         XSelectInput(dpy, c->win, ExposureMask | StructureNotifyMask | PropertyChangeMask);
     } else {
-        XSelectInput(dpy, c->win, EnterWindowMask | FocusChangeMask | PropertyChangeMask | StructureNotifyMask | ButtonPressMask);
+        /* SubstructureNotify caches direct children -> client without tree walks */
+        XSelectInput(dpy, c->win, EnterWindowMask | FocusChangeMask | PropertyChangeMask |
+                                  StructureNotifyMask | SubstructureNotifyMask | ButtonPressMask);
     }
 
     add_client_to_list(c);
+    stack_insert_top(c);
+    if (!c->is_dock) sync_attach(c, q->counter);
 
     XSetWMProtocols(dpy, c->win, &ATOM_WM_DELETE_WINDOW, 1);
 
     if (c->is_dock) {
         /* docks: visible on all workspaces, don't tile, don't take focus */
-        c->workspace = -1; /* mark as global */
+        set_client_workspace(c, -1); /* mark as global */
 
         /* enforce geometry derived from struts (important) */
         apply_dock_geometry(c);
@@ -558,351 +1725,270 @@ static void manage(Window w) {
         /* set above state for compositors */
         set_dock_above_property(c->win);
 
-        /* map and raise dock */
-        XMapWindow(dpy, c->win);
-        XRaiseWindow(dpy, c->win);
+        /* map dock; kept above everything by the stacking order */
+        map_client(c);
 
-        update_global_struts();
-        update_borders();
-        write_occupied_workspace_file();
+        update_struts();
+        queue_borders();
+        queue_status();
         return;
     }
 
-    if (c->workspace == current_workspace) XMapWindow(dpy, c->win);
-
-    write_occupied_workspace_file();
+    map_client(c); /* always lands on the current workspace */
 
     focused = c;
-    XRaiseWindow(dpy, c->win);
-    XSetInputFocus(dpy, c->win, RevertToPointerRoot, CurrentTime);
-    update_borders();
-    write_focused_workspace_file(current_workspace);
+    queue_focus(c);
+    queue_status();
 
-    if (tag_mode[c->workspace] == MODE_TILING) tile_workspace(c->workspace);
+    if (tag_mode[c->workspace] == MODE_TILING) queue_arrange(c->workspace);
 }
 
 static void unmanage(Window w) {
     Client *c = find_client(w);
     if (!c) return;
     int ws = c->workspace;
+    int was_focused = (focused == c);
+    int was_dock = c->is_dock;
+    if (pointer_window == w) pointer_window = None;
+    if (pending.focus == c) pending.focus = NULL;
+    if (drawn_focus == c) drawn_focus = NULL;
+    stack_remove(c);
+    sync_detach(c);
     remove_client_from_list(c);
     free(c);
-    write_occupied_workspace_file();
+    queue_status();
 
     /* recompute reserved areas if a dock was removed */
-    update_global_struts();
+    if (was_dock) update_struts();
 
-    if (focused && !find_client(focused->win)) {
-        focused = NULL;
-        for (Client *cc = clients; cc; cc = cc->next) {
-            if (cc->workspace == current_workspace) { focused = cc; break; }
-        }
-        update_borders();
-        if (focused) {
-            XRaiseWindow(dpy, focused->win);
-            XSetInputFocus(dpy, focused->win, RevertToPointerRoot, CurrentTime);
-            write_focused_workspace_file(current_workspace);
-        } else {
-            write_focused_workspace_file(current_workspace);
-        }
+    if (was_focused) {
+        focused = workspaces[current_workspace].head;
+        queue_borders();
+        if (focused) queue_focus(focused);
+        queue_status();
     }
 
-    if (ws >= 0 && ws < MAX_WORKSPACES && tag_mode[ws] == MODE_TILING) tile_workspace(ws);
+    if (ws >= 0 && ws < MAX_WORKSPACES && tag_mode[ws] == MODE_TILING) queue_arrange(ws);
 }
 
 /* --- move / resize --- */
-static void move_client(Client *c, int start_root_x, int start_root_y, int start_x, int start_y) {
-    if (!c) return;
-    /* defensive: don't allow moving docks */
-    if (c->is_dock) return;
+/* --- interactive move / resize ---
+ * motion is coalesced and the window (or its outline) updated at most
+ * DRAG_FPS times a second, so clients are never asked to redraw faster
+ * than the screen shows it. the final geometry is sent on release.
+ */
+enum { DRAG_MOVE, DRAG_RESIZE };
 
-    XEvent ev;
-    Cursor cur = XCreateFontCursor(dpy, MOVE_CURSOR);
-    XGrabPointer(dpy, root, False,
-                 PointerMotionMask | ButtonReleaseMask,
-                 GrabModeAsync, GrabModeAsync,
-                 None, cur, CurrentTime);
+static void draw_outline(const Client *c) {
+    unsigned int bw = c->abw;
+    XDrawRectangle(dpy, root, outline_gc, c->x, c->y, c->w + 2 * bw - 1, c->h + 2 * bw - 1);
+}
 
-    while (1) {
-        XMaskEvent(dpy, PointerMotionMask | ButtonReleaseMask, &ev);
-        if (ev.type == MotionNotify) {
-            int nx = start_x + (ev.xmotion.x_root - start_root_x);
-            int ny = start_y + (ev.xmotion.y_root - start_root_y);
-            c->x = nx; c->y = ny;
-            XMoveWindow(dpy, c->win, c->x, c->y);
-        } else if (ev.type == ButtonRelease) break;
+/* geometry for a pointer offset (dx, dy) from where the drag started */
+static void drag_geometry(Client *c, int mode, int ox, int oy, unsigned int ow, unsigned int oh, int dx, int dy) {
+    if (mode == DRAG_MOVE) {
+        c->x = ox + dx;
+        c->y = oy + dy;
+    } else {
+        int nw = (int)ow + dx;
+        int nh = (int)oh + dy;
+        c->w = (unsigned int)(nw < MIN_WIN_W ? MIN_WIN_W : nw);
+        c->h = (unsigned int)(nh < MIN_WIN_H ? MIN_WIN_H : nh);
     }
+}
 
-    XUngrabPointer(dpy, CurrentTime);
-    XFreeCursor(dpy, cur);
+/* XCheckIfEvent() predicate that takes nothing, it only notes whether
+ * anything the drag loop handles is already sitting in Xlib's queue */
+static Bool drag_input_queued(Display *d, XEvent *ev, XPointer arg) {
+    (void)d;
+    if (ev->type == MotionNotify || ev->type == ButtonRelease ||
+        (have_sync && ev->type == sync_event_base + XSyncAlarmNotify))
+        *(int *)arg = 1;
+    return False;
 }
 
-static void resize_client(Client *c, int start_root_x, int start_root_y, unsigned int start_w, unsigned int start_h) {
-    if (!c) return;
-    /* defensive: don't allow resizing docks */
-    if (c->is_dock) return;
-    /* don't allow resizing tiling windows */
-    if (c->workspace >= 0 && c->workspace < MAX_WORKSPACES && tag_mode[c->workspace] == MODE_TILING) return;
+static void drag_client(Client *c, int mode, int start_root_x, int start_root_y) {
+    int ox = c->x, oy = c->y;
+    unsigned int ow = c->w, oh = c->h;
+
+    flush_pending(); /* focus and raise before the drag starts */
 
-    XEvent ev;
-    Cursor cur = XCreateFontCursor(dpy, RESIZE_CURSOR);
     XGrabPointer(dpy, root, False,
                  PointerMotionMask | ButtonReleaseMask,
                  GrabModeAsync, GrabModeAsync,
-                 None, cur, CurrentTime);
-
-    while (1) {
-        XMaskEvent(dpy, PointerMotionMask | ButtonReleaseMask, &ev);
-        if (ev.type == MotionNotify) {
-            int nw = (int)start_w + (ev.xmotion.x_root - start_root_x);
-            int nh = (int)start_h + (ev.xmotion.y_root - start_root_y);
-            if (nw < MIN_WIN_W) nw = MIN_WIN_W;
-            if (nh < MIN_WIN_H) nh = MIN_WIN_H;
-            c->w = (unsigned int)nw; c->h = (unsigned int)nh;
-            XResizeWindow(dpy, c->win, c->w, c->h);
-        } else if (ev.type == ButtonRelease) break;
+                 None, mode == DRAG_MOVE ? cursor_move : cursor_resize, CurrentTime);
+    if (DRAG_OUTLINE) {
+        XGrabServer(dpy); /* nothing may draw under the xor outline */
+        draw_outline(c);
     }
 
-    XUngrabPointer(dpy, CurrentTime);
-    XFreeCursor(dpy, cur);
-}
+    const long long frame = 1000 / DRAG_FPS;
+    long long last = 0;
+    int px = start_root_x, py = start_root_y;
+    int moved = 0, done = 0;
+
+    while (!done) {
+        XEvent ev;
+        /* take everything queued; only the newest pointer position counts */
+        while (!done && XCheckMaskEvent(dpy, PointerMotionMask | ButtonReleaseMask, &ev)) {
+            if (ev.type == MotionNotify) {
+                px = ev.xmotion.x_root; py = ev.xmotion.y_root;
+            } else {
+                px = ev.xbutton.x_root; py = ev.xbutton.y_root;
+                done = 1;
+            }
+            moved = 1;
+        }
+        /* resize acks from sync clients, so held back geometry goes out */
+        while (have_sync && XCheckTypedEvent(dpy, sync_event_base + XSyncAlarmNotify, &ev))
+            handle_sync_alarm(&ev);
+        sync_expire();
+        if (done) break;
+
+        long long t = now_ms();
+        if (moved && t - last >= frame) {
+            if (DRAG_OUTLINE) draw_outline(c); /* erase */
+            drag_geometry(c, mode, ox, oy, ow, oh, px - start_root_x, py - start_root_y);
+            if (DRAG_OUTLINE) draw_outline(c);
+            else configure_client(c);
+            XFlush(dpy);
+            last = t;
+            moved = 0;
+        }
 
-/* --- tiling --- */
-static void tile_workspace(int ws) {
-    if (ws < 0 || ws >= MAX_WORKSPACES) return;
-    int count = 0;
-    for (Client *c = clients; c; c = c->next) if (c->workspace == ws) ++count;
-    if (count == 0) return;
+        /* sleep until more input, the next frame, or a sync timeout. the
+         * checks above read the socket dry into Xlib's queue, so input may
+         * already be waiting there that poll() would never report */
+        int timeout = moved ? (int)(frame - (t - last)) : -1;
+        int st = sync_timeout();
+        if (st >= 0 && (timeout < 0 || st < timeout)) timeout = st;
+        int queued = 0;
+        XCheckIfEvent(dpy, &ev, drag_input_queued, (XPointer)&queued);
+        if (queued) continue;
+        struct pollfd pfd = { .fd = ConnectionNumber(dpy), .events = POLLIN };
+        poll(&pfd, 1, timeout);
+    }
 
-    int rw = DisplayWidth(dpy, screen_num);
-    int rh = DisplayHeight(dpy, screen_num);
-
-    int outer_gap = gap_outer < 0 ? 0 : gap_outer;
-    int inner_gap = gap_inner < 0 ? 0 : gap_inner;
-
-    int b = (int)border_unfocus_width;
-
-    // account for reserved dock areas
-    int top_reserve = reserved_top;
-    int bottom_reserve = reserved_bottom;
-    int left_reserve = reserved_left;
-    int right_reserve = reserved_right;
-
-    // effective outer gap does NOT include border thickness (border is handled per window)
-    int avail_w = rw - 2 * outer_gap - left_reserve - right_reserve;
-    int avail_h = rh - 2 * outer_gap - top_reserve - bottom_reserve;
-    if (avail_w < MIN_WIN_W) avail_w = MIN_WIN_W;
-    if (avail_h < MIN_WIN_H) avail_h = MIN_WIN_H;
-
-    int origin_x = outer_gap + left_reserve;
-    int origin_y = outer_gap + top_reserve;
-
-    // if a single client just fill area
-    if (count == 1) {
-        for (Client *c = clients; c; c = c->next) if (c->workspace == ws) {
-            c->x = origin_x;
-            c->y = origin_y;
-            c->w = (unsigned int)(avail_w);
-            c->h = (unsigned int)(avail_h);
-            // Subtract borders after calculating the base dimensions
-            if ((int)c->w > 2 * b) c->w -= 2 * b;
-            if ((int)c->h > 2 * b) c->h -= 2 * b;
-            clamp_size(&c->w, &c->h);
-            XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
-        }
-        return;
+    if (DRAG_OUTLINE) {
+        draw_outline(c);
+        XUngrabServer(dpy);
     }
+    drag_geometry(c, mode, ox, oy, ow, oh, px - start_root_x, py - start_root_y);
+    configure_client(c);
+    XUngrabPointer(dpy, CurrentTime);
+}
 
-    // choose layout for this workspace
-    int layout = workspace_layout[ws];
-    if (layout == LAYOUT_MASTER) {
-        int master_w = (avail_w * DEFAULT_MASTER_FACTOR) / 100;
-        if (master_w < MIN_WIN_W) master_w = MIN_WIN_W;
+static void move_client(Client *c, int start_root_x, int start_root_y) {
+    if (!c) return;
+    /* defensive: don't allow moving docks */
+    if (c->is_dock) return;
+    drag_client(c, DRAG_MOVE, start_root_x, start_root_y);
+}
 
-        int stack_w = avail_w - master_w - inner_gap;
-        if (stack_w < MIN_WIN_W) stack_w = MIN_WIN_W;
+static void resize_client(Client *c, int start_root_x, int start_root_y) {
+    if (!c) return;
+    /* defensive: don't allow resizing docks */
+    if (c->is_dock) return;
+    /* don't allow resizing tiling windows */
+    if (c->workspace >= 0 && c->workspace < MAX_WORKSPACES && tag_mode[c->workspace] == MODE_TILING) return;
+    drag_client(c, DRAG_RESIZE, start_root_x, start_root_y);
+}
 
-        int idx = 0;
-        int stack_count = count - 1;
-        int stack_idx = 0;
+/* --- tiling ---
+ * layout is split in two passes: layout_workspace() only computes target
+ * rects into the clients, commit_workspace() then configures the windows
+ * whose geometry actually changed. hidden workspaces are just marked dirty
+ * and laid out when switched to.
+ */
+static void layout_workspace(int ws) {
+    int count = workspaces[ws].count;
+    if (count == 0) return;
+    workspaces[ws].edges.valid = 0;
+
+    const Output *o = ws_out(ws);
+    LayoutParams p = {
+        .screen_x = o->x,
+        .screen_y = o->y,
+        .screen_w = o->w,
+        .screen_h = o->h,
+        .reserve_top = o->reserve_top,
+        .reserve_bottom = o->reserve_bottom,
+        .reserve_left = o->reserve_left,
+        .reserve_right = o->reserve_right,
+        .gap_outer = workspaces[ws].tune[TUNE_GAP_OUTER],
+        .gap_inner = workspaces[ws].tune[TUNE_GAP_INNER],
+        .border = (int)border_unfocus_width,
+        .master_factor = workspaces[ws].tune[TUNE_MFACT],
+        .nmaster = workspaces[ws].tune[TUNE_NMASTER],
+        .max_w = o->wa.max_w,
+        .max_h = o->wa.max_h,
+    };
 
-        int total_stack_gap = (stack_count > 0) ? (stack_count - 1) * inner_gap : 0;
-        
-        // Calculate stack height accounting for gaps and borders
-        int stack_area_h = avail_h;
-        if (stack_count > 1) {
-            stack_area_h = avail_h - total_stack_gap;
-        }
-        
-        int stack_each_h = (stack_count > 0) ? stack_area_h / stack_count : 0;
-        if (stack_count > 0 && stack_each_h < MIN_WIN_H) {
-            // If individual stack windows would be too small, recalculate
-            stack_each_h = MIN_WIN_H;
-            // Adjust stack_area_h to fit all windows with minimal height
-            if (stack_count > 1) {
-                stack_area_h = stack_count * stack_each_h + (stack_count - 1) * inner_gap;
-                // Adjust master height to accommodate stack height
-                int remaining_h = avail_h - stack_area_h;
-                if (remaining_h < MIN_WIN_H) {
-                    // Distribute space more proportionally if not enough space
-                    int total_req = MIN_WIN_H * count + (stack_count > 1 ? (stack_count - 1) * inner_gap : 0);
-                    if (total_req > avail_h) {
-                        // Too small to accommodate all windows properly
-                        // Distribute available height equally
-                        master_w = avail_w / 2;
-                        stack_w = avail_w - master_w - inner_gap;
-                        stack_each_h = avail_h / count;
-                    }
-                }
-            }
-        }
+    Rect *r = layout_rects(count);
+    if (!r) return;
+    layout_arrange(workspace_layout[ws], &p, &workspaces[ws].lstate, count, r);
 
-        for (Client *c = clients; c; c = c->next) {
-            if (c->workspace != ws) continue;
-            if (idx == 0) {
-                // Master window
-                c->x = origin_x;
-                c->y = origin_y;
-                c->w = (unsigned int)(master_w);
-                c->h = (unsigned int)(avail_h);
-                // Subtract borders after calculating the base dimensions
-                if ((int)c->w > 2 * b) c->w -= 2 * b;
-                if ((int)c->h > 2 * b) c->h -= 2 * b;
-                clamp_size(&c->w, &c->h);
-                XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
-            } else {
-                // Stack windows
-                int ny = origin_y;
-                int nh = (stack_count > 0) ? stack_each_h : avail_h;
-                
-                // Calculate the y position and height for each stack window
-                if (stack_count > 1) {
-                    ny = origin_y + stack_idx * (stack_each_h + inner_gap);
-                    // For the last window, make sure it fills the remaining space
-                    if (stack_idx == stack_count - 1) {
-                        int used_space = stack_idx * (stack_each_h + inner_gap);
-                        nh = avail_h - used_space;
-                        if (nh < MIN_WIN_H) nh = MIN_WIN_H;
-                    }
-                } else {
-                    // Only one stack window
-                    nh = avail_h;
-                }
-
-                c->x = origin_x + master_w + inner_gap;
-                c->y = ny;
-                c->w = (unsigned int)(stack_w);
-                c->h = (unsigned int)(nh);
-                // Subtract borders after calculating the base dimensions
-                if ((int)c->w > 2 * b) c->w -= 2 * b;
-                if ((int)c->h > 2 * b) c->h -= 2 * b;
-                clamp_size(&c->w, &c->h);
-                XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
-                ++stack_idx;
-            }
-            ++idx;
-        }
-        return;
+    int i = 0;
+    for (Client *c = workspaces[ws].head; c; c = c->ws_next, ++i) {
+        c->x = r[i].x;
+        c->y = r[i].y;
+        c->w = (unsigned int)r[i].w;
+        c->h = (unsigned int)r[i].h;
     }
+}
 
-    // dwindle layout: spiral like alternating splits
-    int cnt = 0;
-    Client **arr = collect_workspace_clients(ws, &cnt);
-    if (!arr || cnt == 0) { free(arr); return; }
-
-    dwindle_tile(arr, 0, cnt, origin_x, origin_y, avail_w, avail_h, 0, b, inner_gap);
-
-    free(arr);
+static void commit_workspace(int ws) {
+    for (Client *c = workspaces[ws].head; c; c = c->ws_next) configure_client(c);
 }
 
-/* set workspace layout by index (LAYOUT_MASTER or LAYOUT_DWINDLE) */
-static void set_workspace_layout(int ws, int layout) {
+static void tile_workspace(int ws) {
     if (ws < 0 || ws >= MAX_WORKSPACES) return;
-    workspace_layout[ws] = (layout == LAYOUT_DWINDLE) ? LAYOUT_DWINDLE : LAYOUT_MASTER;
-    if (tag_mode[ws] == MODE_TILING) tile_workspace(ws);
+    if (!ws_visible(ws)) { workspaces[ws].dirty = 1; return; }
+    workspaces[ws].dirty = 0;
+    stat_layout();
+    layout_workspace(ws);
+    commit_workspace(ws);
 }
 
-static void set_layout_for_all(int layout) {
-    for (int w = 0; w < MAX_WORKSPACES; ++w) {
-        workspace_layout[w] = (layout == LAYOUT_DWINDLE) ? LAYOUT_DWINDLE : LAYOUT_MASTER;
-        if (tag_mode[w] == MODE_TILING) tile_workspace(w);
-    }
+/* set workspace layout by index into layouts[] */
+static void set_workspace_layout(int ws, int layout) {
+    if (ws < 0 || ws >= MAX_WORKSPACES || layout < 0 || layout >= LAYOUT_COUNT) return;
+    workspace_layout[ws] = layout;
+    if (tag_mode[ws] == MODE_TILING) queue_arrange(ws);
 }
 
-/* dwindle recursive tiler
- * arr[start] is placed first in the available rect then we recurse on remaining
- * horiz == 0 -> split vertically (place first on left)
- * horiz == 1 -> split horizontally (place first on top)
+/* set (or with relative, move) one knob of a workspace. a change goes
+ * through queue_arrange like any other, so a hidden workspace is only
+ * marked dirty and nothing is redone when the value did not move.
  */
-static void dwindle_tile(Client **arr, int start, int n, int x, int y, int w, int h, int horiz, int b, int inner_gap) {
-    if (n <= 0) return;
-    if (n == 1) {
-        Client *c = arr[start];
-        c->x = x;
-        c->y = y;
-        c->w = (unsigned int)(w);
-        c->h = (unsigned int)(h);
-        // Subtract borders after calculating the base dimensions
-        if ((int)c->w > 2 * b) c->w -= 2 * b;
-        if ((int)c->h > 2 * b) c->h -= 2 * b;
-        if ((int)c->w < 1) c->w = 1;
-        if ((int)c->h < 1) c->h = 1;
-        clamp_size(&c->w, &c->h);
-        XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
-        return;
-    }
+static void set_workspace_tune(int ws, int what, int value, int relative) {
+    if (ws < 0 || ws >= MAX_WORKSPACES || what < 0 || what >= TUNE_COUNT) return;
+    int *v = &workspaces[ws].tune[what];
+    if (relative) value += *v;
+    if (value < tunables[what].min) value = tunables[what].min;
+    if (value > tunables[what].max) value = tunables[what].max;
+    if (value == *v) return;
+    *v = value;
+    if (tag_mode[ws] == MODE_TILING) queue_arrange(ws);
+}
 
-    // compute split amount based on DEFAULT_MASTER_FACTOR
-    if (horiz == 0) {
-        int amount = (w * DEFAULT_MASTER_FACTOR) / 100;
-        if (amount < MIN_WIN_W) amount = MIN_WIN_W;
-        if (amount > w - (MIN_WIN_W + inner_gap)) amount = w - (MIN_WIN_W + inner_gap);
-        if (amount < 1) amount = 1;
-
-        // place first client on left
-        Client *c = arr[start];
-        c->x = x;
-        c->y = y;
-        c->w = (unsigned int)(amount);
-        c->h = (unsigned int)(h);
-        // Subtract borders after calculating the base dimensions
-        if ((int)c->w > 2 * b) c->w -= 2 * b;
-        if ((int)c->h > 2 * b) c->h -= 2 * b;
-        if ((int)c->w < 1) c->w = 1;
-        if ((int)c->h < 1) c->h = 1;
-        clamp_size(&c->w, &c->h);
-        XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
-
-        // recurse on remaining to the right, flip orientation
-        int nx = x + amount + inner_gap;
-        int nw = w - amount - inner_gap;
-        if (nw < MIN_WIN_W) nw = MIN_WIN_W;
-        dwindle_tile(arr, start + 1, n - 1, nx, y, nw, h, 1, b, inner_gap);
-    } else {
-        int amount = (h * DEFAULT_MASTER_FACTOR) / 100;
-        if (amount < MIN_WIN_H) amount = MIN_WIN_H;
-        if (amount > h - (MIN_WIN_H + inner_gap)) amount = h - (MIN_WIN_H + inner_gap);
-        if (amount < 1) amount = 1;
-
-        // place first client on top
-        Client *c = arr[start];
-        c->x = x;
-        c->y = y;
-        c->w = (unsigned int)(w);
-        c->h = (unsigned int)(amount);
-        // Subtract borders after calculating the base dimensions
-        if ((int)c->w > 2 * b) c->w -= 2 * b;
-        if ((int)c->h > 2 * b) c->h -= 2 * b;
-        if ((int)c->w < 1) c->w = 1;
-        if ((int)c->h < 1) c->h = 1;
-        clamp_size(&c->w, &c->h);
-        XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
-
-        // recurse on remaining below, flip orientation
-        int ny = y + amount + inner_gap;
-        int nh = h - amount - inner_gap;
-        if (nh < MIN_WIN_H) nh = MIN_WIN_H;
-        dwindle_tile(arr, start + 1, n - 1, x, ny, w, nh, 0, b, inner_gap);
+/* grow or shrink the split the focused window sits in, for layouts that
+ * keep their own ratios; returns 0 if there was nothing to resize */
+static int resize_focused_split(int delta) {
+    if (!focused || focused->workspace < 0) return 0;
+    int ws = focused->workspace;
+    if (tag_mode[ws] != MODE_TILING) return 0;
+    Workspace *w = &workspaces[ws];
+    if (!layout_resize(workspace_layout[ws], &w->lstate, ws_index(w, focused), delta)) return 0;
+    queue_arrange(ws);
+    return 1;
+}
+
+static void set_layout_for_all(int layout) {
+    if (layout < 0 || layout >= LAYOUT_COUNT) return;
+    for (int w = 0; w < MAX_WORKSPACES; ++w) {
+        workspace_layout[w] = layout;
+        if (tag_mode[w] == MODE_TILING) queue_arrange(w);
     }
 }
 
@@ -911,165 +1997,428 @@ static void dwindle_tile(Client **arr, int start, int n, int x, int y, int w, in
 static void set_workspace_mode(int ws, int mode) {
     if (ws < 0 || ws >= MAX_WORKSPACES) return;
     tag_mode[ws] = (mode == MODE_TILING) ? MODE_TILING : MODE_FLOATING;
-    if (tag_mode[ws] == MODE_TILING) tile_workspace(ws);
+    if (tag_mode[ws] == MODE_TILING) queue_arrange(ws);
 }
 
 static void set_mode_for_all(int mode) {
     for (int w = 0; w < MAX_WORKSPACES; ++w) {
         tag_mode[w] = (mode == MODE_TILING) ? MODE_TILING : MODE_FLOATING;
-        if (tag_mode[w] == MODE_TILING) tile_workspace(w);
+        if (tag_mode[w] == MODE_TILING) queue_arrange(w);
     }
 }
 
+/* put ws on output o, moving its floating windows along if the output is
+ * not the one they were placed for, then lay it out and map it */
+static void place_workspace(int ws, int o) {
+    Workspace *w = &workspaces[ws];
+    ws_output[ws] = o;
+    outputs[o].workspace = ws;
+    pending.workarea = 1;
+    int dx = outputs[o].x - w->ox, dy = outputs[o].y - w->oy;
+    if (dx || dy) {
+        w->ox = outputs[o].x;
+        w->oy = outputs[o].y;
+        w->dirty = 1;
+        if (tag_mode[ws] != MODE_TILING)
+            for (Client *c = w->head; c; c = c->ws_next) {
+                c->x += dx;
+                c->y += dy;
+                configure_client(c);
+            }
+    }
+
+    /* lay out before mapping so windows appear at their final geometry */
+    if (tag_mode[ws] == MODE_TILING && w->dirty) tile_workspace(ws);
+    for (Client *c = w->head; c; c = c->ws_next) show_client(c);
+}
+
+static void unplace_workspace(int ws) {
+    ws_output[ws] = -1;
+    pending.workarea = 1;
+    for (Client *c = workspaces[ws].head; c; c = c->ws_next) hide_client(c);
+}
+
+/* show ws on the current output; one already shown elsewhere just gets
+ * the focus, as if the pointer had gone there */
 static void switch_workspace(int ws) {
     if (ws < 0 || ws >= MAX_WORKSPACES) return;
     if (ws == current_workspace) return;
+    int old = current_workspace;
     current_workspace = ws;
+    pointer_window = None; /* refocus whatever is under the pointer on next motion */
 
-    for (Client *c = clients; c; c = c->next) {
-        if (c->workspace == current_workspace || c->workspace == -1) XMapWindow(dpy, c->win);
-        else XUnmapWindow(dpy, c->win);
+    if (ws_visible(ws)) {
+        current_output = ws_output[ws];
+    } else {
+        /* only the two workspaces involved change visibility; docks stay mapped */
+        place_workspace(ws, current_output);
+        unplace_workspace(old);
     }
 
-    focused = NULL;
-    for (Client *c = clients; c; c = c->next) {
-        if (c->workspace == current_workspace) { focused = c; break; }
-    }
-    if (focused) {
-        XRaiseWindow(dpy, focused->win);
-        XSetInputFocus(dpy, focused->win, RevertToPointerRoot, CurrentTime);
-    }
+    focused = workspaces[current_workspace].head;
+    if (focused) queue_focus(focused);
 
-    if (tag_mode[current_workspace] == MODE_TILING) tile_workspace(current_workspace);
+    queue_borders();
+    queue_status();
+}
 
-    update_borders();
-    write_focused_workspace_file(current_workspace);
-    write_occupied_workspace_file();
+/* make the workspace on output o current, e.g. when the pointer moves there */
+static void focus_output(int o) {
+    if (o == current_output || o < 0 || o >= noutputs) return;
+    current_output = o;
+    current_workspace = outputs[o].workspace;
+    focused = workspaces[current_workspace].head;
+    if (focused) queue_focus(focused);
+    queue_borders();
+    queue_status();
 }
 
 static void move_focused_to_workspace(int ws) {
     if (!focused) return;
     if (ws < 0 || ws >= MAX_WORKSPACES) return;
-    focused->workspace = ws;
-    if (focused->workspace != current_workspace) XUnmapWindow(dpy, focused->win);
-    write_occupied_workspace_file();
+    int from = focused->workspace;
+    set_client_workspace(focused, ws);
+    if (!ws_visible(ws)) {
+        hide_client(focused);
+    } else if (tag_mode[ws] != MODE_TILING && ws_output[ws] != ws_output[from]) {
+        /* floating: keep the same place on the other output */
+        focused->x += workspaces[ws].ox - ws_out(from)->x;
+        focused->y += workspaces[ws].oy - ws_out(from)->y;
+        configure_client(focused);
+    }
+    queue_status();
+
+    if (tag_mode[ws] == MODE_TILING) queue_arrange(ws);
+    if (tag_mode[current_workspace] == MODE_TILING) queue_arrange(current_workspace);
+}
+
+/* monitor rects, primary first; n == 0 without RandR or monitors */
+static int read_outputs(Output *out) {
+    int n = 0;
+#ifdef XRANDR
+    if (have_randr) {
+        int nmon = 0;
+        XRRMonitorInfo *m = XRRGetMonitors(dpy, root, True, &nmon);
+        for (int i = 0; m && i < nmon && n < MAX_OUTPUTS; ++i) {
+            if (m[i].width <= 0 || m[i].height <= 0) continue;
+            Output o = { .x = m[i].x, .y = m[i].y, .w = m[i].width, .h = m[i].height };
+            out[n] = o;
+            if (m[i].primary && n) {
+                out[n] = out[0];
+                out[0] = o;
+            }
+            ++n;
+        }
+        if (m) XRRFreeMonitors(m);
+    }
+#else
+    (void)out;
+#endif
+    return n;
+}
+
+/* re-read the outputs after a screen change. outputs that remain keep their
+ * workspace, new ones show the lowest hidden workspace, and everything is
+ * laid out again for the new geometry. */
+static void update_outputs(void) {
+    Output next[MAX_OUTPUTS];
+    int n = read_outputs(next);
+    if (!n) {
+        next[0] = (Output){ .w = screen_w, .h = screen_h };
+        n = 1;
+    }
+    int same = n == noutputs;
+    for (int i = 0; same && i < n; ++i)
+        same = next[i].x == outputs[i].x && next[i].y == outputs[i].y &&
+               next[i].w == outputs[i].w && next[i].h == outputs[i].h;
+    if (same) return;
+
+    int was[MAX_WORKSPACES];
+    memcpy(was, ws_output, sizeof(was));
+    for (int ws = 0; ws < MAX_WORKSPACES; ++ws) ws_output[ws] = -1;
+    for (int i = 0; i < n; ++i) {
+        int ws = i < noutputs ? outputs[i].workspace : -1;
+        outputs[i] = next[i];
+        outputs[i].workspace = ws;
+        if (ws >= 0) ws_output[ws] = i;
+    }
+    for (int i = noutputs; i < n; ++i) {
+        int ws = 0;
+        while (ws_output[ws] >= 0) ++ws;
+        outputs[i].workspace = ws;
+        ws_output[ws] = i;
+    }
+    noutputs = n;
+    if (current_output >= noutputs) current_output = 0;
+    current_workspace = outputs[current_output].workspace;
 
-    if (tag_mode[ws] == MODE_TILING) tile_workspace(ws);
-    if (tag_mode[current_workspace] == MODE_TILING) tile_workspace(current_workspace);
+    update_global_struts();
+    for (Client *c = clients; c; c = c->next)
+        if (c->is_dock) apply_dock_geometry(c);
+
+    for (int ws = 0; ws < MAX_WORKSPACES; ++ws) {
+        workspaces[ws].dirty = 1;
+        if (ws_output[ws] >= 0) {
+            place_workspace(ws, ws_output[ws]);
+        } else if (was[ws] >= 0) {
+            unplace_workspace(ws);
+        }
+    }
+    if (focused && !ws_visible(focused->workspace)) focused = workspaces[current_workspace].head;
+    if (focused) queue_focus(focused);
+    queue_borders();
+    queue_status();
 }
 
-/* --- Alt-Tab --- */
-static void start_cycle(void) {
-    if (!clients) return;
+static void init_outputs(void) {
+    screen_w = DisplayWidth(dpy, screen_num);
+    screen_h = DisplayHeight(dpy, screen_num);
+#ifdef XRANDR
+    /* monitors need RandR 1.5 */
+    int rr_error_base, rr_major = 0, rr_minor = 0;
+    if (XRRQueryExtension(dpy, &randr_event_base, &rr_error_base) &&
+        XRRQueryVersion(dpy, &rr_major, &rr_minor) && (rr_major > 1 || rr_minor >= 5)) {
+        have_randr = 1;
+        XRRSelectInput(dpy, root, RRScreenChangeNotifyMask);
+    }
+#endif
+    for (int ws = 0; ws < MAX_WORKSPACES; ++ws) ws_output[ws] = -1;
+    noutputs = 0;
+    update_outputs();
+}
+
+/* the root window changed size: without RandR that is all we learn */
+static void handle_screen_change(XEvent *ev) {
+#ifdef XRANDR
+    if (have_randr) {
+        if (ev->type == ConfigureNotify) return; /* RandR reports the same change */
+        XRRScreenChangeNotifyEvent *se = (XRRScreenChangeNotifyEvent *)ev;
+        XRRUpdateConfiguration(ev);
+        screen_w = se->width;
+        screen_h = se->height;
+        update_outputs();
+        return;
+    }
+#endif
+    screen_w = ev->xconfigure.width;
+    screen_h = ev->xconfigure.height;
+    update_outputs();
+}
+
+/* --- Alt-Tab ---
+ * steps walk the mru ring of the current workspace. nothing is raised and
+ * the ring keeps its order until the cycle ends, when the window landed on
+ * comes up and moves to the front.
+ */
+static void start_cycle(unsigned int mods) {
+    if (!workspaces[current_workspace].mru) return;
+    /* whatever has focus now is where the cycle starts from */
+    if (focused && focused->workspace == current_workspace) mru_touch(focused);
     cycling = 1;
-    cycle_start = focused;
+    cycle_mods = mods;
+    /* without the keyboard the modifier release would go to the client */
+    cycle_grabbed = XGrabKeyboard(dpy, root, True, GrabModeAsync, GrabModeAsync, CurrentTime) == GrabSuccess;
+    stat_sync();
+    if (cycle_grabbed && mods) {
+        /* a quick flick may have let go before the grab took hold */
+        Window r, ch;
+        int rx, ry, wx, wy;
+        unsigned int mask;
+        int ok = XQueryPointer(dpy, root, &r, &ch, &rx, &ry, &wx, &wy, &mask);
+        stat_sync();
+        if (ok && !(mask & mods)) cycle_mods = 0;
+    }
 }
 
 static void cycle_focus(int forward) {
-    if (!clients || !cycling) return;
-
-    Client *start = focused ? focused : clients;
-    Client *c = start;
-
-    do {
-        c = forward ? (c->next ? c->next : clients) : (c->prev ? c->prev : NULL);
-        if (!c) c = clients;
-        while (c && c->workspace != current_workspace) {
-            c = forward ? (c->next ? c->next : clients) : (c->prev ? c->prev : NULL);
-            if (!c) c = clients;
-            if (c == start) break;
-        }
-        if (c && c->workspace == current_workspace) break;
-    } while (c && c != start);
+    Workspace *ws = &workspaces[current_workspace];
+    if (!ws->mru || !cycling) return;
+
+    Client *c;
+    if (!focused || focused->workspace != current_workspace) c = ws->mru;
+    else c = forward ? focused->mru_next : focused->mru_prev;
 
     if (c && c != focused) {
         focused = c;
-        XRaiseWindow(dpy, focused->win);
-        XSetInputFocus(dpy, focused->win, RevertToPointerRoot, CurrentTime);
-        update_borders();
+        queue_focus(focused);
+        queue_borders();
     }
 }
 
 static void stop_cycle(void) {
+    if (!cycling) return;
     cycling = 0;
-    cycle_start = NULL;
+    if (cycle_grabbed) XUngrabKeyboard(dpy, CurrentTime);
+    cycle_grabbed = 0;
+    cycle_mods = 0;
+    mru_touch(focused);
+    queue_borders(); /* raises it */
 }
 
-/* --- key grabbing --- */
-static void grab_keycode_for_keysym_for_mods(KeySym keysym) {
-    unsigned int bases[2] = { MOD_MAIN, Mod1Mask };
-    for (int b = 0; b < 2; ++b) {
-        KeyCode kc = XKeysymToKeycode(dpy, keysym);
-        if (kc == 0) continue;
-        unsigned int masks[] = {
-            0,
-            LockMask,
-            Mod2Mask,
-            LockMask | Mod2Mask,
-            ShiftMask,
-            ShiftMask | LockMask,
-            ShiftMask | Mod2Mask,
-            ShiftMask | LockMask | Mod2Mask
-        };
-        for (size_t i = 0; i < sizeof(masks)/sizeof(masks[0]); ++i)
-            XGrabKey(dpy, kc, bases[b] | masks[i], root, True, GrabModeAsync, GrabModeAsync);
-    }
+/* --- key bindings ---
+ * what every key does is a row in config.binds: the defaults below, or
+ * whatever the config file made of them. BIND_MOD stands for the mod key
+ * and is resolved against config.mod, so changing the mod key shows up as
+ * changed bindings. alt is accepted in place of the mod key as well.
+ */
+#define BIND_MOD     (1u << 15)
+#define MAX_BINDINGS 160
+#define MAX_COMMANDS 32
+#define COMMAND_MAX  256
+
+enum {
+    ACT_CLOSE, ACT_SPAWN, ACT_WORKSPACE, ACT_SEND, ACT_CYCLE, ACT_MODE, ACT_FOCUS, ACT_SWAP,
+    ACT_FULLSCREEN, ACT_SPLIT, ACT_GAP, ACT_NMASTER, ACT_LAYOUT, ACT_QUIT, ACT_COUNT
+};
+static const char *const action_names[ACT_COUNT] = {
+    "close", "spawn", "workspace", "send", "cycle", "mode", "focus", "swap",
+    "fullscreen", "split", "gap", "nmaster", "layout", "quit"
+};
+
+enum { CMD_TERMINAL, CMD_LAUNCHER, CMD_FIXED }; /* fixed slots in commands[] */
+
+typedef struct {
+    KeySym sym;
+    unsigned int mods;  /* may include BIND_MOD */
+    short action;
+    short arg;          /* workspace, direction, step, all (mode) or command slot */
+} Binding;
+
+/* everything the config file can set */
+typedef struct {
+    char color_focus[64], color_unfocus[64];
+    unsigned int border_focus, border_unfocus;
+    unsigned int mod;
+    int layout;
+    int tune[TUNE_COUNT];
+    char commands[MAX_COMMANDS][COMMAND_MAX]; /* run with /bin/sh -c */
+    int ncommands;
+    Binding binds[MAX_BINDINGS];
+    int nbinds;
+} Config;
+
+static Config config; /* in effect; all zero until the first apply_config() */
+
+#define M BIND_MOD
+#define S ShiftMask
+static const Binding default_bindings[] = {
+    { XK_Return,       M,     ACT_SPAWN,      CMD_TERMINAL },
+    { XK_d,            M,     ACT_SPAWN,      CMD_LAUNCHER },
+    { XK_q,            M,     ACT_CLOSE,      0 },
+    { XK_a,            M,     ACT_CLOSE,      0 },
+    { XK_f,            M,     ACT_FULLSCREEN, 0 },
+    { XK_Tab,          M,     ACT_CYCLE,      1 },
+    { XK_Tab,          M | S, ACT_CYCLE,      -1 },
+    { XK_t,            M,     ACT_MODE,       0 },
+    { XK_t,            M | S, ACT_MODE,       1 },
+    { XK_space,        M,     ACT_LAYOUT,     1 },
+    { XK_space,        M | S, ACT_LAYOUT,     -1 },
+    { XK_comma,        M,     ACT_SPLIT,      -SPLIT_STEP },
+    { XK_period,       M,     ACT_SPLIT,      SPLIT_STEP },
+    { XK_comma,        M | S, ACT_GAP,        -GAP_STEP },
+    { XK_period,       M | S, ACT_GAP,        GAP_STEP },
+    { XK_bracketleft,  M,     ACT_NMASTER,    -1 },
+    { XK_bracketright, M,     ACT_NMASTER,    1 },
+    { XK_h,            M,     ACT_FOCUS,      0 },
+    { XK_j,            M,     ACT_FOCUS,      1 },
+    { XK_k,            M,     ACT_FOCUS,      2 },
+    { XK_l,            M,     ACT_FOCUS,      3 },
+    { XK_Left,         M,     ACT_FOCUS,      0 },
+    { XK_Down,         M,     ACT_FOCUS,      1 },
+    { XK_Up,           M,     ACT_FOCUS,      2 },
+    { XK_Right,        M,     ACT_FOCUS,      3 },
+    { XK_h,            M | S, ACT_SWAP,       0 },
+    { XK_j,            M | S, ACT_SWAP,       1 },
+    { XK_k,            M | S, ACT_SWAP,       2 },
+    { XK_l,            M | S, ACT_SWAP,       3 },
+    { XK_Left,         M | S, ACT_SWAP,       0 },
+    { XK_Down,         M | S, ACT_SWAP,       1 },
+    { XK_Up,           M | S, ACT_SWAP,       2 },
+    { XK_Right,        M | S, ACT_SWAP,       3 },
+    { XK_e,            M | S, ACT_QUIT,       0 },
+};
+#undef M
+#undef S
+
+/* digits, and the unshifted top row of a french layout */
+static const KeySym workspace_keys[2][MAX_WORKSPACES] = {
+    { XK_1, XK_2, XK_3, XK_4, XK_5, XK_6, XK_7, XK_8, XK_9 },
+    { XK_ampersand, XK_eacute, XK_quotedbl, XK_apostrophe, XK_parenleft,
+      XK_minus, XK_egrave, XK_underscore, XK_ccedilla },
+};
+
+static unsigned int bind_mods(const Binding *b, unsigned int mod) {
+    return (b->mods & ~BIND_MOD) | ((b->mods & BIND_MOD) ? mod : 0);
 }
 
-static void grab_keys_and_buttons(void) {
-    grab_keycode_for_keysym_for_mods(XK_Return);
-    grab_keycode_for_keysym_for_mods(XK_d);
-    grab_keycode_for_keysym_for_mods(XK_f);
-    grab_keycode_for_keysym_for_mods(XK_Tab);
-    grab_keycode_for_keysym_for_mods(XK_t);
-
-    grab_keycode_for_keysym_for_mods(XK_h);
-    grab_keycode_for_keysym_for_mods(XK_j);
-    grab_keycode_for_keysym_for_mods(XK_k);
-    grab_keycode_for_keysym_for_mods(XK_l);
-
-    /* arrows too */
-    grab_keycode_for_keysym_for_mods(XK_Left);
-    grab_keycode_for_keysym_for_mods(XK_Down);
-    grab_keycode_for_keysym_for_mods(XK_Up);
-    grab_keycode_for_keysym_for_mods(XK_Right);
+/* --- key grabbing --- */
+/* lock and numlock must not stop a binding from firing */
+static const unsigned int lock_masks[] = { 0, LockMask, Mod2Mask, LockMask | Mod2Mask };
+
+/* --- key dispatch ---
+ * keycode x modifier state -> binding, rebuilt whenever the bindings or
+ * the keymap change, so a keypress costs one lookup. lock and numlock are
+ * not part of the state; alt gets entries of its own for mod bindings.
+ * the set entries are exactly the grabs we hold.
+ */
+#define MOD_STATES 64 /* shift, control, mod1, mod3, mod4, mod5 */
+typedef unsigned char KeyTable[256][MOD_STATES]; /* binding index + 1, 0 = unbound */
 
-    for (int i = 0; i < MAX_WORKSPACES; ++i) {
-        grab_keycode_for_keysym_for_mods(XK_1 + i);
-    }
+static KeyTable key_dispatch;
 
-    KeySym french_top[MAX_WORKSPACES] = {
-        XK_ampersand, XK_eacute, XK_quotedbl, XK_apostrophe, XK_parenleft,
-        XK_minus, XK_egrave, XK_underscore, XK_ccedilla
-    };
-    for (int i = 0; i < MAX_WORKSPACES; ++i) grab_keycode_for_keysym_for_mods(french_top[i]);
+static unsigned int mod_index(unsigned int state) {
+    return (state & ShiftMask) | ((state >> 1) & 0x06) | ((state >> 2) & 0x38);
+}
 
-    grab_keycode_for_keysym_for_mods(XK_q);
-    grab_keycode_for_keysym_for_mods(XK_a);
+static unsigned int mod_state(unsigned int index) {
+    return (index & 0x01) | ((index & 0x06) << 1) | ((index & 0x38) << 2);
+}
 
-    grab_keycode_for_keysym_for_mods(XK_e);
+static void build_key_table(const Config *cf, KeyTable t) {
+    memset(t, 0, sizeof(KeyTable));
+    /* exact bindings first, so the alt alias never shadows one */
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int i = 0; i < cf->nbinds; ++i) {
+            const Binding *b = &cf->binds[i];
+            if (pass && (!(b->mods & BIND_MOD) || cf->mod == Mod1Mask)) continue;
+            KeyCode kc = XKeysymToKeycode(dpy, b->sym);
+            if (kc == 0) continue;
+            unsigned char *slot = &t[kc][mod_index(bind_mods(b, pass ? Mod1Mask : cf->mod))];
+            if (!pass || !*slot) *slot = (unsigned char)(i + 1);
+        }
+    }
+}
 
-    unsigned int bases[2] = { MOD_MAIN, Mod1Mask };
-    for (int b = 0; b < 2; ++b) {
-        unsigned int base = bases[b];
-        XGrabButton(dpy, Button1, base, root, True, ButtonPressMask, GrabModeAsync, GrabModeAsync, None, None);
-        XGrabButton(dpy, Button3, base, root, True, ButtonPressMask, GrabModeAsync, GrabModeAsync, None, None);
+/* move the grabs from what old binds to what next binds */
+static void regrab_keys(KeyTable old, KeyTable next) {
+    for (int kc = 8; kc < 256; ++kc) {
+        for (unsigned int m = 0; m < MOD_STATES; ++m) {
+            if (!old[kc][m] == !next[kc][m]) continue;
+            for (size_t i = 0; i < sizeof(lock_masks) / sizeof(lock_masks[0]); ++i) {
+                unsigned int mods = mod_state(m) | lock_masks[i];
+                if (next[kc][m]) XGrabKey(dpy, kc, mods, root, True, GrabModeAsync, GrabModeAsync);
+                else XUngrabKey(dpy, kc, mods, root);
+            }
+        }
     }
 }
 
-/* --- key -> workspace --- */
-static int keysym_to_workspace(KeySym ks) {
-    if (ks >= XK_1 && ks <= XK_9) return (int)(ks - XK_1);
-    if (ks == XK_ampersand)    return 0;
-    if (ks == XK_eacute)      return 1;
-    if (ks == XK_quotedbl)    return 2;
-    if (ks == XK_apostrophe)  return 3;
-    if (ks == XK_parenleft)   return 4;
-    if (ks == XK_minus)       return 5;
-    if (ks == XK_egrave)      return 6;
-    if (ks == XK_underscore)  return 7;
-    if (ks == XK_ccedilla)    return 8;
-    return -1;
+static void update_key_table(const Config *cf) {
+    static KeyTable next;
+    build_key_table(cf, next);
+    regrab_keys(key_dispatch, next);
+    memcpy(key_dispatch, next, sizeof(KeyTable));
+}
+
+/* mod + left drag moves, mod + right drag resizes */
+static void grab_buttons(unsigned int mod, int grab) {
+    unsigned int bases[2] = { mod, Mod1Mask };
+    for (int b = 0; b < (mod != Mod1Mask ? 2 : 1); ++b) {
+        for (unsigned int button = Button1; button <= Button3; button += 2) {
+            if (grab) XGrabButton(dpy, button, bases[b], root, True, ButtonPressMask, GrabModeAsync, GrabModeAsync, None, None);
+            else XUngrabButton(dpy, button, bases[b], root);
+        }
+    }
 }
 
 /* --- focus helpers --- */
@@ -1078,36 +2427,32 @@ static void focus_client_proper(Client *c) {
     if (c->workspace != current_workspace) return;
     if (focused && focused == c) return;
     focused = c;
-    XRaiseWindow(dpy, c->win);
-    XSetInputFocus(dpy, c->win, RevertToPointerRoot, CurrentTime);
-    update_borders(); /* will restack docks after raising focused window */
-    write_focused_workspace_file(current_workspace);
+    queue_focus(c);
+    queue_borders(); /* raises the focused window, then restacks docks */
+    queue_status();
 }
 
 /* bring a window to "priority" - raise it, focus it and ensure borders */
 static void make_priority(Client *c) {
     if (!c) return;
-    if (c->workspace != current_workspace && c->workspace != -1) {
-        /* don't automatically switch workspace here; just ignore */
+    if (c->workspace != current_workspace && ws_visible(c->workspace)) {
+        /* a window on another output: that output becomes the current one */
+        current_output = ws_output[c->workspace];
+        current_workspace = c->workspace;
     }
-    focused = c;
-    XMapWindow(dpy, c->win);
-    XRaiseWindow(dpy, c->win);
-    XSetInputFocus(dpy, c->win, RevertToPointerRoot, CurrentTime);
-    update_borders();
-    write_focused_workspace_file(current_workspace);
-}
-
-static void focus_window_at_pointer(void) {
-    Window ret_root, ret_child;
-    int root_x, root_y, win_x, win_y;
-    unsigned int mask;
-    if (!XQueryPointer(dpy, root, &ret_root, &ret_child, &root_x, &root_y, &win_x, &win_y, &mask)) return;
-    Client *c = find_toplevel_client_from_window(ret_child ? ret_child : ret_root);
+    focused = c; /* only ever called for visible clients, which are mapped */
+    queue_focus(c);
+    queue_borders();
+    queue_status();
+}
+
+/* focus the client owning w, the root child under the pointer */
+static void focus_window_at_pointer(Window w) {
+    Client *c = find_toplevel_client_from_window(w);
     if (!c) return;
     /* don't focus docks on pointer enter */
     if (c->is_dock) return;
-    if (c && c->workspace == current_workspace) make_priority(c);
+    if (ws_visible(c->workspace)) make_priority(c);
 }
 
 /* helper: compute overlap length between [a1,a2) and [b1,b2) */
@@ -1118,16 +2463,12 @@ static int overlap_len(int a1, int a2, int b1, int b2) {
 }
 
 /* --- improved directional finder (sway/i3-like) --- */
-static Client *find_neighbor_in_direction(Client *cur, int dir) {
-    if (!clients) return NULL;
-
-    Client *start = cur;
-    if (!start || start->workspace != current_workspace) {
-        for (start = clients; start && start->workspace != current_workspace; start = start->next);
-        if (!start) return NULL;
-    }
-    cur = start;
 
+/* score of candidate c seen from cur; lower is better. candidates lying in
+ * the requested direction score below -1e9 (below -1.5e9 when they also
+ * overlap cur on the perpendicular axis).
+ */
+static long long neighbor_score(const Client *cur, const Client *c, int dir, int *in_dir_out) {
     int cx1 = cur->x;
     int cy1 = cur->y;
     int cx2 = cur->x + (int)cur->w;
@@ -1135,90 +2476,104 @@ static Client *find_neighbor_in_direction(Client *cur, int dir) {
     int ccx = cx1 + (int)cur->w / 2;
     int ccy = cy1 + (int)cur->h / 2;
 
-    Client *best = NULL;
-    long long best_score = LLONG_MAX;
-    int found_in_dir = 0;
+    int ax1 = c->x;
+    int ay1 = c->y;
+    int ax2 = c->x + (int)c->w;
+    int ay2 = c->y + (int)c->h;
+    int acx = ax1 + (int)c->w / 2;
+    int acy = ay1 + (int)c->h / 2;
+
+    int overlap_perp = 0;
+    int in_dir = 0;
+    long long primary = 0;
+    long long secondary = 0;
+
+    if (dir == 0) {
+        overlap_perp = overlap_len(ay1, ay2, cy1, cy2);
+        if (ax2 <= cx1) {
+            in_dir = 1;
+            primary = (long long)(cx1 - ax2);
+        } else if (overlap_perp > 0 && ax1 < cx1) {
+            in_dir = 1;
+            primary = 0;
+        } else {
+            in_dir = 0;
+            primary = (long long)llabs((long long)acx - (long long)ccx);
+        }
+        secondary = overlap_perp > 0 ? 0 : (long long)llabs((long long)acy - (long long)ccy);
+    } else if (dir == 3) {
+        overlap_perp = overlap_len(ay1, ay2, cy1, cy2);
+        if (ax1 >= cx2) {
+            in_dir = 1;
+            primary = (long long)(ax1 - cx2);
+        } else if (overlap_perp > 0 && ax2 > cx2) {
+            in_dir = 1;
+            primary = 0;
+        } else {
+            in_dir = 0;
+            primary = (long long)llabs((long long)acx - (long long)ccx);
+        }
+        secondary = overlap_perp > 0 ? 0 : (long long)llabs((long long)acy - (long long)ccy);
+    } else if (dir == 2) {
+        overlap_perp = overlap_len(ax1, ax2, cx1, cx2);
+        if (ay2 <= cy1) {
+            in_dir = 1;
+            primary = (long long)(cy1 - ay2);
+        } else if (overlap_perp > 0 && ay1 < cy1) {
+            in_dir = 1;
+            primary = 0;
+        } else {
+            in_dir = 0;
+            primary = (long long)llabs((long long)acy - (long long)ccy);
+        }
+        secondary = overlap_perp > 0 ? 0 : (long long)llabs((long long)acx - (long long)ccx);
+    } else {
+        overlap_perp = overlap_len(ax1, ax2, cx1, cx2);
+        if (ay1 >= cy2) {
+            in_dir = 1;
+            primary = (long long)(ay1 - cy2);
+        } else if (overlap_perp > 0 && ay2 > cy2) {
+            in_dir = 1;
+            primary = 0;
+        } else {
+            in_dir = 0;
+            primary = (long long)llabs((long long)acy - (long long)ccy);
+        }
+        secondary = overlap_perp > 0 ? 0 : (long long)llabs((long long)acx - (long long)ccx);
+    }
 
-    for (Client *c = clients; c; c = c->next) {
-        if (c->workspace != current_workspace) continue;
-        if (c == cur) continue;
-        if (c->is_dock) continue;
+    long long score = primary * 100000LL + secondary * 100LL;
+
+    if (in_dir) {
+        score -= 1000000000LL;
+        if (overlap_perp > 0) score -= 500000000LL;
+    }
 
-        int ax1 = c->x;
-        int ay1 = c->y;
-        int ax2 = c->x + (int)c->w;
-        int ay2 = c->y + (int)c->h;
-        int acx = ax1 + (int)c->w / 2;
-        int acy = ay1 + (int)c->h / 2;
+    *in_dir_out = in_dir;
+    return score;
 
-        int overlap_perp = 0;
-        int in_dir = 0;
-        long long primary = 0;
-        long long secondary = 0;
-
-        if (dir == 0) {
-            overlap_perp = overlap_len(ay1, ay2, cy1, cy2);
-            if (ax2 <= cx1) {
-                in_dir = 1;
-                primary = (long long)(cx1 - ax2);
-            } else if (overlap_perp > 0 && ax1 < cx1) {
-                in_dir = 1;
-                primary = 0;
-            } else {
-                in_dir = 0;
-                primary = (long long)llabs((long long)acx - (long long)ccx);
-            }
-            secondary = overlap_perp > 0 ? 0 : (long long)llabs((long long)acy - (long long)ccy);
-        } else if (dir == 3) {
-            overlap_perp = overlap_len(ay1, ay2, cy1, cy2);
-            if (ax1 >= cx2) {
-                in_dir = 1;
-                primary = (long long)(ax1 - cx2);
-            } else if (overlap_perp > 0 && ax2 > cx2) {
-                in_dir = 1;
-                primary = 0;
-            } else {
-                in_dir = 0;
-                primary = (long long)llabs((long long)acx - (long long)ccx);
-            }
-            secondary = overlap_perp > 0 ? 0 : (long long)llabs((long long)acy - (long long)ccy);
-        } else if (dir == 2) {
-            overlap_perp = overlap_len(ax1, ax2, cx1, cx2);
-            if (ay2 <= cy1) {
-                in_dir = 1;
-                primary = (long long)(cy1 - ay2);
-            } else if (overlap_perp > 0 && ay1 < cy1) {
-                in_dir = 1;
-                primary = 0;
-            } else {
-                in_dir = 0;
-                primary = (long long)llabs((long long)acy - (long long)ccy);
-            }
-            secondary = overlap_perp > 0 ? 0 : (long long)llabs((long long)acx - (long long)ccx);
-        } else {
-            overlap_perp = overlap_len(ax1, ax2, cx1, cx2);
-            if (ay1 >= cy2) {
-                in_dir = 1;
-                primary = (long long)(ay1 - cy2);
-            } else if (overlap_perp > 0 && ay2 > cy2) {
-                in_dir = 1;
-                primary = 0;
-            } else {
-                in_dir = 0;
-                primary = (long long)llabs((long long)acy - (long long)ccy);
-            }
-            secondary = overlap_perp > 0 ? 0 : (long long)llabs((long long)acx - (long long)ccx);
-        }
+}
+
+/* reference scan over the whole workspace */
+static Client *find_neighbor_linear(Client *cur, int dir) {
+    int ccx = cur->x + (int)cur->w / 2;
+    int ccy = cur->y + (int)cur->h / 2;
+
+    Client *best = NULL;
+    long long best_score = LLONG_MAX;
+    int found_in_dir = 0;
 
-        long long score = primary * 100000LL + secondary * 100LL;
+    for (Client *c = workspaces[current_workspace].head; c; c = c->ws_next) {
+        if (c == cur) continue;
+        if (c->is_dock) continue;
 
-        if (in_dir) {
-            score -= 1000000000LL;
-            found_in_dir = 1;
-            if (overlap_perp > 0) score -= 500000000LL;
-        }
+        int in_dir = 0;
+        long long score = neighbor_score(cur, c, dir, &in_dir);
+        if (in_dir) found_in_dir = 1;
 
         if (!found_in_dir) {
+            int acx = c->x + (int)c->w / 2;
+            int acy = c->y + (int)c->h / 2;
             long long dx = (long long)(acx - ccx);
             long long dy = (long long)(acy - ccy);
             long long center_dist = dx * dx + dy * dy;
@@ -1234,61 +2589,191 @@ static Client *find_neighbor_in_direction(Client *cur, int dir) {
     return best;
 }
 
-static void swap_clients(Client *a, Client *b) {
-    if (!a || !b || a == b) return;
-    if (a->workspace != b->workspace) return;
+/* --- directional focus index ---
+ * per workspace, the clients' extents sorted by each edge. it is rebuilt on
+ * the first query after any geometry or membership change, so repeated
+ * focus moves only pay for binary searches plus the candidates that can
+ * still beat the best score found so far.
+ */
+static int edge_sort_axis;
+
+static int edge_cmp_lo(const void *pa, const void *pb) {
+    const EdgeEntry *a = *(EdgeEntry *const *)pa, *b = *(EdgeEntry *const *)pb;
+    if (a->lo[edge_sort_axis] != b->lo[edge_sort_axis]) return a->lo[edge_sort_axis] < b->lo[edge_sort_axis] ? -1 : 1;
+    return a->ord - b->ord;
+}
+
+static int edge_cmp_hi(const void *pa, const void *pb) {
+    const EdgeEntry *a = *(EdgeEntry *const *)pa, *b = *(EdgeEntry *const *)pb;
+    if (a->hi[edge_sort_axis] != b->hi[edge_sort_axis]) return a->hi[edge_sort_axis] < b->hi[edge_sort_axis] ? -1 : 1;
+    return a->ord - b->ord;
+}
+
+static EdgeIndex *edge_index(int ws) {
+    EdgeIndex *ix = &workspaces[ws].edges;
+    if (ix->valid) return ix;
+
+    int n = workspaces[ws].count;
+    if (n > ix->cap) {
+        int ncap = ix->cap ? ix->cap : 16;
+        while (ncap < n) ncap *= 2;
+        EdgeEntry *e = realloc(ix->entries, (size_t)ncap * sizeof(EdgeEntry));
+        if (!e) die("out of memory");
+        ix->entries = e;
+        for (int a = 0; a < 2; ++a) {
+            EdgeEntry **lo = realloc(ix->by_lo[a], (size_t)ncap * sizeof(EdgeEntry *));
+            if (lo) ix->by_lo[a] = lo;
+            EdgeEntry **hi = realloc(ix->by_hi[a], (size_t)ncap * sizeof(EdgeEntry *));
+            if (hi) ix->by_hi[a] = hi;
+            if (!lo || !hi) die("out of memory");
+        }
+        ix->cap = ncap;
+    }
+
+    ix->n = 0;
+    ix->max_ext[0] = ix->max_ext[1] = 0;
+    for (Client *c = workspaces[ws].head; c; c = c->ws_next) {
+        EdgeEntry *e = &ix->entries[ix->n];
+        e->c = c;
+        e->lo[0] = c->x; e->hi[0] = c->x + (int)c->w;
+        e->lo[1] = c->y; e->hi[1] = c->y + (int)c->h;
+        e->ord = ix->n;
+        if ((int)c->w > ix->max_ext[0]) ix->max_ext[0] = (int)c->w;
+        if ((int)c->h > ix->max_ext[1]) ix->max_ext[1] = (int)c->h;
+        for (int a = 0; a < 2; ++a) ix->by_lo[a][ix->n] = ix->by_hi[a][ix->n] = e;
+        ++ix->n;
+    }
+    for (int a = 0; a < 2; ++a) {
+        edge_sort_axis = a;
+        qsort(ix->by_lo[a], ix->n, sizeof(EdgeEntry *), edge_cmp_lo);
+        qsort(ix->by_hi[a], ix->n, sizeof(EdgeEntry *), edge_cmp_hi);
+    }
+    ix->valid = 1;
+    return ix;
+}
+
+static void edge_index_invalidate(int ws) {
+    if (ws >= 0 && ws < MAX_WORKSPACES) workspaces[ws].edges.valid = 0;
+}
 
-    Client *a_prev = a->prev;
-    Client *a_next = a->next;
-    Client *b_prev = b->prev;
-    Client *b_next = b->next;
+/* first position in arr whose lo (or hi) edge on axis is >= v */
+static int edge_lower_bound(EdgeEntry **arr, int n, int axis, int use_hi, int v) {
+    int lo = 0, hi = n;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int key = use_hi ? arr[mid]->hi[axis] : arr[mid]->lo[axis];
+        if (key < v) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
 
-    int a_was_head = (clients == a);
-    int b_was_head = (clients == b);
+typedef struct {
+    Client *cur;
+    int dir;
+    Client *best;
+    long long best_score;
+    int best_ord;
+} NeighborQuery;
+
+static void neighbor_consider(NeighborQuery *q, const EdgeEntry *e) {
+    if (e->c == q->cur || e->c->is_dock) return;
+    int in_dir = 0;
+    long long score = neighbor_score(q->cur, e->c, q->dir, &in_dir);
+    if (!in_dir) return;
+    /* ties go to the client earlier in the workspace list, like the scan */
+    if (score < q->best_score || (score == q->best_score && e->ord < q->best_ord)) {
+        q->best = e->c;
+        q->best_score = score;
+        q->best_ord = e->ord;
+    }
+}
 
-    if (a_next == b) {
-        /* a immediately before b */
-        if (a_prev) a_prev->next = b;
-        b->prev = a_prev;
+/* Same answer as find_neighbor_linear(): once any candidate lies in the
+ * requested direction the best in-direction score wins, and those are
+ * negative while every other candidate scores >= 0. Two groups can be in
+ * direction: clients beyond cur's leading edge (walked outwards from that
+ * edge and cut off once their distance alone rules them out) and clients
+ * straddling that edge, found through the widest extent. With no negative
+ * result (nothing in direction, or absurdly distant windows) fall back to
+ * the full scan.
+ */
+static Client *find_neighbor_in_direction(Client *cur, int dir) {
+    Client *head = workspaces[current_workspace].head;
+    if (!head) return NULL;
 
-        a->next = b_next;
-        if (b_next) b_next->prev = a;
+    if (!cur || cur->workspace != current_workspace) cur = head;
 
-        b->next = a;
-        a->prev = b;
-    } else if (b_next == a) {
-        /* b immediately before a */
-        if (b_prev) b_prev->next = a;
-        a->prev = b_prev;
+    EdgeIndex *ix = edge_index(current_workspace);
+    int axis = (dir == 0 || dir == 3) ? 0 : 1;
+    int towards_lo = (dir == 0 || dir == 2); /* left / up */
+    int c_lo = axis ? cur->y : cur->x;
+    int c_hi = c_lo + (int)(axis ? cur->h : cur->w);
+    int edge = towards_lo ? c_lo : c_hi;
 
-        b->next = a_next;
-        if (a_next) a_next->prev = b;
+    NeighborQuery q = { cur, dir, NULL, LLONG_MAX, INT_MAX };
 
-        a->next = b;
-        b->prev = a;
-    } else {
-        /* non-adjacent */
-        if (a_prev) a_prev->next = b;
-        if (a_next) a_next->prev = b;
-        if (b_prev) b_prev->next = a;
-        if (b_next) b_next->prev = a;
+    /* straddling the leading edge: lo in (edge - max_ext, edge), hi > edge */
+    EdgeEntry **by_lo = ix->by_lo[axis];
+    for (int i = edge_lower_bound(by_lo, ix->n, axis, 0, edge - ix->max_ext[axis] + 1);
+         i < ix->n && by_lo[i]->lo[axis] < edge; ++i) {
+        if (by_lo[i]->hi[axis] > edge) neighbor_consider(&q, by_lo[i]);
+    }
 
-        a->prev = b_prev;
-        a->next = b_next;
-        b->prev = a_prev;
-        b->next = a_next;
+    /* beyond the leading edge, nearest first; a candidate at distance d scores
+     * at least d * 100000 - 1500000000
+     */
+    if (towards_lo) {
+        EdgeEntry **by_hi = ix->by_hi[axis];
+        for (int i = edge_lower_bound(by_hi, ix->n, axis, 1, edge + 1) - 1; i >= 0; --i) {
+            long long d = (long long)edge - by_hi[i]->hi[axis];
+            if (d * 100000LL - 1500000000LL > q.best_score) break;
+            neighbor_consider(&q, by_hi[i]);
+        }
+    } else {
+        for (int i = edge_lower_bound(by_lo, ix->n, axis, 0, edge); i < ix->n; ++i) {
+            long long d = (long long)by_lo[i]->lo[axis] - edge;
+            if (d * 100000LL - 1500000000LL > q.best_score) break;
+            neighbor_consider(&q, by_lo[i]);
+        }
     }
 
-    if (a_was_head) clients = b;
-    else if (b_was_head) clients = a;
+    if (!q.best || q.best_score >= 0) return find_neighbor_linear(cur, dir);
+    return q.best;
+}
+
+/* swap a and b in their workspace list (layout order) */
+static void swap_clients(Client *a, Client *b) {
+    if (!a || !b || a == b) return;
+    if (a->workspace != b->workspace) return;
+    if (a->workspace < 0) return;
+
+    Workspace *ws = &workspaces[a->workspace];
+    ws->edges.valid = 0;
+    if (a->ws_next == b) {
+        ws_unlink(ws, a);
+        ws_insert_after(ws, b, a);
+    } else if (b->ws_next == a) {
+        ws_unlink(ws, b);
+        ws_insert_after(ws, a, b);
+    } else {
+        /* non-adjacent: each takes the other's place */
+        Client *a_prev = a->ws_prev;
+        Client *b_prev = b->ws_prev;
+        ws_unlink(ws, a);
+        ws_unlink(ws, b);
+        ws_insert_after(ws, a_prev, b);
+        ws_insert_after(ws, b_prev, a);
+    }
 
     /* NO focus change here. Caller must call make_priority() or focus_client_proper()
      * on the client that should remain focused after the swap.
      */
 }
 
-/* swap helper that grabs server, retile, update borders, then focuses the moved client
- * This reduces race conditions where focus ends up on the wrong window.
+/* swap helper: swap, retile, then keep focus on the moved client.
+ * everything lands in the same deferred batch, so the server sees the new
+ * geometry and the focus change together.
  */
 static void swap_clients_keep_focus(Client *a, Client *b) {
     if (!a || !b) return;
@@ -1299,49 +2784,27 @@ static void swap_clients_keep_focus(Client *a, Client *b) {
     /* we want focus to stay on 'a' (the client the user moved). store it. */
     Client *moved = a;
 
-    XGrabServer(dpy);
-
     swap_clients(a, b);
 
-    if (tag_mode[current_workspace] == MODE_TILING) tile_workspace(current_workspace);
-
-    update_global_struts();
-    update_borders();
-    write_occupied_workspace_file();
-
-    XSync(dpy, False);
-
-    focus_client_proper(moved);
+    if (tag_mode[current_workspace] == MODE_TILING) queue_arrange(current_workspace);
 
-    XSync(dpy, False);
-    XUngrabServer(dpy);
-}
-
-/* helper: collect clients for a workspace into an array */
-static Client **collect_workspace_clients(int ws, int *out_count) {
-    int cnt = 0;
-    for (Client *c = clients; c; c = c->next) if (c->workspace == ws) ++cnt;
-    if (out_count) *out_count = cnt;
-    if (cnt == 0) return NULL;
-    Client **arr = calloc(cnt, sizeof(Client*));
-    int i = 0;
-    for (Client *c = clients; c; c = c->next) if (c->workspace == ws) arr[i++] = c;
-    return arr;
+    focused = moved;
+    queue_focus(moved);
+    queue_borders();
 }
 
 /* focus_in_direction (reworked + fallback for master -> stack)
  * Use the geometric neighbor finder for most cases.
  * If that fails (or returns the same window), and the focused client is the
  * master window in the master/stack ordering, prefer the top of the stack
- * (arr[1]). As a last resort, pick an "extreme" window in the requested
+ * (the second client). As a last resort, pick an "extreme" window in the requested
  * direction excluding the currently focused window.
  */
 static void focus_in_direction(int dir) {
     /* if nothing focused, pick an extreme in the given direction */
     if (!focused) {
         Client *best = NULL;
-        for (Client *c = clients; c; c = c->next) {
-            if (c->workspace != current_workspace) continue;
+        for (Client *c = workspaces[current_workspace].head; c; c = c->ws_next) {
             if (c->is_dock) continue;
             if (!best) { best = c; continue; }
             int bcx = best->x + (int)best->w / 2;
@@ -1369,25 +2832,16 @@ static void focus_in_direction(int dir) {
         return;
     }
 
-    /* fallback 1: if focused is master (first in client-list order), pick top of stack */
-    int cnt = 0;
-    Client **arr = collect_workspace_clients(current_workspace, &cnt);
-    if (arr) {
-        if (cnt > 1 && arr[0] == focused) {
-            Client *stack_top = arr[1];
-            if (stack_top && !stack_top->is_dock) {
-                focus_client_proper(stack_top);
-                free(arr);
-                return;
-            }
-        }
-        free(arr);
+    /* fallback 1: if focused is master (first in workspace order), pick top of stack */
+    Client *master = workspaces[current_workspace].head;
+    if (master == focused && master->ws_next && !master->ws_next->is_dock) {
+        focus_client_proper(master->ws_next);
+        return;
     }
 
     /* fallback 2: pick an extreme excluding the currently focused window */
     Client *best = NULL;
-    for (Client *c = clients; c; c = c->next) {
-        if (c->workspace != current_workspace) continue;
+    for (Client *c = workspaces[current_workspace].head; c; c = c->ws_next) {
         if (c->is_dock) continue;
         if (c == focused) continue;
         if (!best) { best = c; continue; }
@@ -1405,8 +2859,56 @@ static void focus_in_direction(int dir) {
 
 /* --- event handlers --- */
 static void handle_maprequest(XEvent *ev) { manage(ev->xmaprequest.window); }
-static void handle_destroynotify(XEvent *ev) { unmanage(ev->xdestroywindow.window); }
-static void handle_unmapnotify(XEvent *ev) { (void)ev; }
+static void handle_destroynotify(XEvent *ev) {
+    winmap_del(&ancestry, ev->xdestroywindow.window);
+    unmanage(ev->xdestroywindow.window);
+}
+/* a client unmapping itself withdraws it (ICCCM 4.1.4); unmaps we caused
+ * by hiding a workspace are counted and skipped. the root's copy of the
+ * event is the one used, which also carries the synthetic withdraw
+ * notice a client sends for a window that was already unmapped. */
+static void handle_unmapnotify(XEvent *ev) {
+    XUnmapEvent *e = &ev->xunmap;
+    if (e->event != root) return;
+    Client *c = find_client(e->window);
+    if (!c) return;
+    if (!e->send_event && c->unmaps_expected > 0) {
+        --c->unmaps_expected;
+        return;
+    }
+    unmanage(e->window);
+}
+
+/* subwindow bookkeeping for find_toplevel_client_from_window().
+ * managed windows select SubstructureNotify, so their direct children are
+ * cached as they appear. nothing deeper is selected on: that would cost a
+ * request per subwindow and every event of large toolkit trees, so deeper
+ * windows are resolved by the query-tree walk on their first cache miss.
+ * entries go when the client does (winmap_del_client).
+ */
+static void track_subwindow(Window w, Client *c) {
+    winmap_put(&ancestry, w, c);
+}
+
+static void handle_createnotify(XEvent *ev) {
+    XCreateWindowEvent *e = &ev->xcreatewindow;
+    if (e->parent == root) return; /* new toplevel; MapRequest will follow */
+    Client *c = find_cached_toplevel(e->parent);
+    if (c) track_subwindow(e->window, c);
+}
+
+static void handle_reparentnotify(XEvent *ev) {
+    XReparentEvent *e = &ev->xreparent;
+    if (find_client(e->window)) return;
+    Client *old = winmap_get(&ancestry, e->window);
+    Client *c = (e->parent == root) ? NULL : find_cached_toplevel(e->parent);
+    if (old && old != c) {
+        /* a subtree moved between clients; its cached descendants are stale */
+        winmap_clear(&ancestry);
+    }
+    if (c) track_subwindow(e->window, c);
+    else winmap_del(&ancestry, e->window);
+}
 
 static void handle_configurerequest(XEvent *ev) {
     XConfigureRequestEvent *e = &ev->xconfigurerequest;
@@ -1419,9 +2921,8 @@ static void handle_configurerequest(XEvent *ev) {
         /* Re-read strut in case it changed and reapply geometry */
         get_window_type_and_strut(e->window, c);
         apply_dock_geometry(c);
-        update_global_struts();
-        update_borders();
-        write_occupied_workspace_file();
+        update_struts();
+        queue_borders();
         return;
     }
 
@@ -1430,26 +2931,49 @@ static void handle_configurerequest(XEvent *ev) {
     changes.width = e->width; changes.height = e->height;
     changes.border_width = e->border_width;
     changes.sibling = e->above; changes.stack_mode = e->detail;
-    XConfigureWindow(dpy, e->window, e->value_mask, &changes);
+    unsigned int mask = e->value_mask;
+    /* parked off-screen: only remember where it wants to be, see below */
+    if (c && c->hidden && HIDE_OFFSCREEN) mask &= ~(CWX | CWY);
+    if (c) {
+        /* managed windows are stacked through the model: a plain raise is
+         * honoured there, anything else is left to our own order */
+        if ((mask & CWStackMode) && e->detail == Above && !(mask & CWSibling)) raise_client(c);
+        mask &= ~(CWSibling | CWStackMode);
+    }
+    if (mask) XConfigureWindow(dpy, e->window, mask, &changes);
 
     if (c) {
-        XWindowAttributes wa;
-        if (XGetWindowAttributes(dpy, e->window, &wa)) {
-            c->x = wa.x; c->y = wa.y; c->w = wa.width; c->h = wa.height;
-            clamp_size(&c->w, &c->h);
-        }
+        /* the server applies exactly what we passed on; no need to ask it back */
+        if (mask & CWX) c->ax = e->x;
+        if (mask & CWY) c->ay = e->y;
+        if (mask & CWWidth) c->aw = (unsigned int)e->width;
+        if (mask & CWHeight) c->ah = (unsigned int)e->height;
+        if (e->value_mask & CWX) c->x = e->x;
+        if (e->value_mask & CWY) c->y = e->y;
+        if (e->value_mask & CWWidth) c->w = (unsigned int)e->width;
+        if (e->value_mask & CWHeight) c->h = (unsigned int)e->height;
+        clamp_size(c->workspace, &c->w, &c->h);
+        edge_index_invalidate(c->workspace);
     }
 }
 
 static void handle_enternotify(XEvent *ev) {
     Window w = ev->xcrossing.window;
     Client *c = find_toplevel_client_from_window(w);
-    if (c && c->workspace == current_workspace && !c->is_dock) make_priority(c);
+    if (c && ws_visible(c->workspace) && !c->is_dock) make_priority(c);
 }
 
 static void handle_motionnotify(XEvent *ev) {
-    (void)ev;
-    focus_window_at_pointer();
+    /* compress: only the newest queued motion matters */
+    while (XCheckTypedEvent(dpy, MotionNotify, ev));
+    XMotionEvent *me = &ev->xmotion;
+    if (me->window != root) return;
+    /* over the root of another output: follow it even without a window there */
+    if (noutputs > 1 && me->subwindow == None) focus_output(output_at(me->x_root, me->y_root));
+    /* the event already says which root child is under the pointer */
+    if (me->subwindow == pointer_window) return;
+    pointer_window = me->subwindow;
+    focus_window_at_pointer(pointer_window);
 }
 
 static void handle_buttonpress(XEvent *ev) {
@@ -1469,84 +2993,97 @@ static void handle_buttonpress(XEvent *ev) {
 
     make_priority(c);
 
-    if (be->button == Button1) move_client(c, be->x_root, be->y_root, c->x, c->y);
-    else if (be->button == Button3) resize_client(c, be->x_root, be->y_root, c->w, c->h);
+    if (be->button == Button1) move_client(c, be->x_root, be->y_root);
+    else if (be->button == Button3) resize_client(c, be->x_root, be->y_root);
 }
 
-static void handle_keypress(XEvent *ev) {
-    XKeyEvent *ke = &ev->xkey;
-    KeySym ks = XLookupKeysym(ke, 0);
-    unsigned int state = ke->state & ~(LockMask | Mod2Mask);
-    unsigned int mod_accept = MOD_MAIN | Mod1Mask;
-
-    if ((state & mod_accept) && (ks == XK_q || ks == XK_a)) {
-        if (focused) { send_wm_delete(focused->win); }
-        return;
-    }
-
-    if ((state & mod_accept) && (ke->state & ShiftMask)) {
-        int ws = keysym_to_workspace(ks);
-        if (ws >= 0 && ws < MAX_WORKSPACES) { move_focused_to_workspace(ws); return; }
-    }
+static void spawn_command(int slot) {
+    if (slot < 0 || slot >= config.ncommands || !config.commands[slot][0]) return;
+    char *argv[] = { "/bin/sh", "-c", config.commands[slot], NULL };
+    spawn_program(argv);
+}
 
-    if ((state & mod_accept) && ks == XK_Tab) {
-        if (!cycling) start_cycle();
-        cycle_focus(!(ke->state & ShiftMask));
-        return;
+static void run_binding(const Binding *b, unsigned int state) {
+    int ws = current_workspace;
+    switch (b->action) {
+    case ACT_CLOSE:
+        if (focused) send_wm_delete(focused->win);
+        break;
+    case ACT_SPAWN:
+        spawn_command(b->arg);
+        break;
+    case ACT_WORKSPACE:
+        switch_workspace(b->arg);
+        break;
+    case ACT_SEND:
+        move_focused_to_workspace(b->arg);
+        break;
+    case ACT_CYCLE:
+        if (!cycling) start_cycle(state & ~(ShiftMask | LockMask | Mod2Mask));
+        cycle_focus(b->arg > 0);
+        if (cycling && cycle_grabbed && !cycle_mods) stop_cycle();
+        break;
+    case ACT_MODE:
+        if (b->arg) set_mode_for_all(tag_mode[0] == MODE_TILING ? MODE_FLOATING : MODE_TILING);
+        else set_workspace_mode(ws, tag_mode[ws] == MODE_TILING ? MODE_FLOATING : MODE_TILING);
+        break;
+    case ACT_FOCUS:
+        focus_in_direction(b->arg);
+        break;
+    case ACT_SWAP: {
+        if (!focused) break;
+        Client *cand = find_neighbor_in_direction(focused, b->arg);
+        if (cand && cand->workspace == current_workspace && !cand->is_dock) swap_clients_keep_focus(focused, cand);
+        break;
     }
-
-    if ((state & mod_accept) && ks == XK_t) {
-        if (ke->state & ShiftMask) {
-            int newmode = (tag_mode[0] == MODE_TILING) ? MODE_FLOATING : MODE_TILING;
-            set_mode_for_all(newmode);
-        } else {
-            int ws = current_workspace;
-            int newmode = (tag_mode[ws] == MODE_TILING) ? MODE_FLOATING : MODE_TILING;
-            set_workspace_mode(ws, newmode);
-        }
-        return;
+    case ACT_FULLSCREEN:
+        if (focused) toggle_fullscreen(focused);
+        break;
+    case ACT_SPLIT:
+        if (!resize_focused_split(b->arg)) set_workspace_tune(ws, TUNE_MFACT, b->arg, 1);
+        break;
+    case ACT_GAP:
+        set_workspace_tune(ws, TUNE_GAP_INNER, b->arg, 1);
+        break;
+    case ACT_NMASTER:
+        set_workspace_tune(ws, TUNE_NMASTER, b->arg, 1);
+        break;
+    case ACT_LAYOUT:
+        set_workspace_layout(ws, ((workspace_layout[ws] + b->arg) % LAYOUT_COUNT + LAYOUT_COUNT) % LAYOUT_COUNT);
+        break;
+    case ACT_QUIT:
+        XCloseDisplay(dpy);
+        exit(EXIT_SUCCESS);
     }
+}
 
-    /* map arrows to hjkl behavior */
-    int dir = -1;
-    if (ks == XK_h || ks == XK_Left) dir = 0;
-    else if (ks == XK_j || ks == XK_Down) dir = 1;
-    else if (ks == XK_k || ks == XK_Up) dir = 2;
-    else if (ks == XK_l || ks == XK_Right) dir = 3;
-
-    if ((state & mod_accept) && dir != -1) {
-        if (ke->state & ShiftMask) {
-            if (!focused) return;
-            Client *cand = find_neighbor_in_direction(focused, dir);
-            if (cand && cand->workspace == current_workspace && !cand->is_dock) {
-                swap_clients_keep_focus(focused, cand);
-            }
-            return;
-        } else {
-            focus_in_direction(dir);
-            return;
-        }
-    }
+static const Binding *key_binding(const XKeyEvent *ke) {
+    int i = key_dispatch[ke->keycode & 0xff][mod_index(ke->state)];
+    return i ? &config.binds[i - 1] : NULL;
+}
 
-    if (state & mod_accept) {
-        if (ks == XK_Return) { spawn_program(term_cmd); return; }
-        if (ks == XK_d) { spawn_program(dmenu_cmd); return; }
-        if (ks == XK_f) { if (focused) toggle_fullscreen(focused); return; }
-        if ((ke->state & ShiftMask) && ks == XK_e) { XCloseDisplay(dpy); exit(EXIT_SUCCESS); }
-        int ws = keysym_to_workspace(ks);
-        if (ws >= 0 && ws < MAX_WORKSPACES) { switch_workspace(ws); return; }
-    }
+static void handle_keypress(XEvent *ev) {
+    const Binding *b = key_binding(&ev->xkey);
+    if (b) run_binding(b, ev->xkey.state);
 }
 
+/* alt-tab ends when the modifier holding it goes up (shift only picks the
+ * direction); without the keyboard grab, releasing the cycling key does */
 static void handle_keyrelease(XEvent *ev) {
-    XKeyEvent *ke = &ev->xkey;
-    KeySym ks = XLookupKeysym(ke, 0);
-    unsigned int state = ke->state & ~(LockMask | Mod2Mask);
-    unsigned int mod_accept = MOD_MAIN | Mod1Mask;
-
-    if ((state & mod_accept) && ks == XK_Tab) {
-        stop_cycle();
+    if (!cycling) return;
+    if (cycle_grabbed) {
+        KeySym ks = XLookupKeysym(&ev->xkey, 0);
+        if (IsModifierKey(ks) && ks != XK_Shift_L && ks != XK_Shift_R) stop_cycle();
+        return;
     }
+    const Binding *b = key_binding(&ev->xkey);
+    if (b && b->action == ACT_CYCLE) stop_cycle();
+}
+
+/* keycodes moved: follow them with the table and the grabs */
+static void handle_mappingnotify(XEvent *ev) {
+    XRefreshKeyboardMapping(&ev->xmapping);
+    if (ev->xmapping.request == MappingKeyboard) update_key_table(&config);
 }
 
 static void handle_clientmessage(XEvent *ev) {
@@ -1568,15 +3105,608 @@ static void handle_propertynotify(XEvent *ev) {
         /* re-read strut and reapply geometry */
         get_window_type_and_strut(c->win, c);
         apply_dock_geometry(c);
-        update_global_struts();
-        /* re-tile visible workspace(s) */
-        for (int i = 0; i < MAX_WORKSPACES; ++i)
-            if (tag_mode[i] == MODE_TILING) tile_workspace(i);
-        update_borders();
+        update_struts(); /* re-tiles only where the work area moved */
+        queue_borders();
+    }
+}
+
+/* --- control socket ---
+ * ~/.wm/ctl takes one command per line and answers each with one line,
+ * "ok [value]" or "err <reason>". commands do what their keys do and only
+ * queue work, so everything read in one wakeup is laid out and sent to
+ * the server in a single flush. queries answer from memory, not ~/.wm.
+ *
+ *   workspace N          send N             fullscreen
+ *   layout N|all master|dwindle|monocle|grid|centered|bsp
+ *   swap left|down|up|right                 ratio +N|-N (focused bsp split)
+ *   mode N|all tiling|floating|toggle
+ *   set N|all mfact|nmaster|gap_inner|gap_outer V|+V|-V
+ *   get workspace|focused|occupied          get layout|mode|clients [N]
+ *   get mfact|nmaster|gap_inner|gap_outer [N]
+ *   stats [ROW|reset]    (WM_STATS builds)
+ */
+#define IPC_MAX_CLIENTS 8
+#define IPC_LINE_MAX    256
+#define IPC_MAX_ARGS    4
+
+typedef struct {
+    int fd;
+    size_t len;
+    char buf[IPC_LINE_MAX];
+} IpcClient;
+
+static int ipc_fd = -1;
+static struct sockaddr_un ipc_addr;   /* ~/.wm/ctl */
+static IpcClient ipc_clients[IPC_MAX_CLIENTS];
+static int ipc_nclients = 0;
+
+static int set_nonblocking(int fd) {
+    int fl = fcntl(fd, F_GETFL);
+    if (fl < 0 || fcntl(fd, F_SETFL, fl | O_NONBLOCK) < 0) return -1;
+    return fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+/* remove ~/.wm/ctl on the way out so the next run finds no stale socket */
+static void ipc_shutdown(void) {
+    if (ipc_fd < 0) return;
+    close(ipc_fd);
+    ipc_fd = -1;
+    unlink(ipc_addr.sun_path);
+}
+
+static void init_ipc(void) {
+    const char *home = getenv("HOME");
+    if (!home) return;
+    ipc_addr.sun_family = AF_UNIX;
+    if (snprintf(ipc_addr.sun_path, sizeof(ipc_addr.sun_path), "%s/.wm/ctl", home) >= (int)sizeof(ipc_addr.sun_path))
+        return;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return;
+    /* HOME is shared across displays, so a wm on another one may own the
+     * path: only a socket nobody answers on is left over and safe to remove */
+    if (connect(fd, (struct sockaddr *)&ipc_addr, sizeof(ipc_addr)) == 0) {
+        fprintf(stderr, "wm: control socket %s is in use, running without one\n", ipc_addr.sun_path);
+        close(fd);
+        return;
+    }
+    if (errno == ECONNREFUSED) unlink(ipc_addr.sun_path);
+    close(fd);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return;
+    if (set_nonblocking(fd) < 0 || bind(fd, (struct sockaddr *)&ipc_addr, sizeof(ipc_addr)) < 0 || listen(fd, IPC_MAX_CLIENTS) < 0) {
+        fprintf(stderr, "wm: control socket: %s\n", strerror(errno));
+        close(fd);
+        return;
+    }
+    ipc_fd = fd;
+    atexit(ipc_shutdown); /* quit and die() both leave through exit() */
+}
+
+static void ipc_close(IpcClient *cl) {
+    if (cl->fd < 0) return;
+    close(cl->fd);
+    cl->fd = -1;
+}
+
+static void ipc_reply(IpcClient *cl, const char *fmt, ...) {
+    char buf[IPC_LINE_MAX];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(buf, sizeof(buf) - 1, fmt, ap);
+    va_end(ap);
+    if (len < 0) return;
+    if (len > (int)sizeof(buf) - 2) len = (int)sizeof(buf) - 2;
+    buf[len++] = '\n';
+    /* replies are short; a client that lets its socket fill up is dropped */
+    if (cl->fd >= 0 && send(cl->fd, buf, len, MSG_NOSIGNAL) != len) ipc_close(cl);
+}
+
+/* "1".."9" -> 0..8, "all" -> MAX_WORKSPACES, else -1 */
+static int ipc_workspace(const char *s, int allow_all) {
+    if (allow_all && strcmp(s, "all") == 0) return MAX_WORKSPACES;
+    if (s[0] < '1' || s[0] > '0' + MAX_WORKSPACES || s[1]) return -1;
+    return s[0] - '1';
+}
+
+static int ipc_lookup(const char *s, const char *const *names, int n) {
+    for (int i = 0; i < n; ++i)
+        if (strcmp(s, names[i]) == 0) return i;
+    return -1;
+}
+
+static int ipc_tunable(const char *s) {
+    for (int i = 0; i < TUNE_COUNT; ++i)
+        if (strcmp(s, tunables[i].name) == 0) return i;
+    return -1;
+}
+
+static void ipc_get(IpcClient *cl, int argc, char **argv) {
+    static const char *const mode_names[] = { "floating", "tiling" };
+    const char *what = argv[1];
+    if (strcmp(what, "workspace") == 0) {
+        ipc_reply(cl, "ok %d", current_workspace + 1);
+    } else if (strcmp(what, "focused") == 0) {
+        if (focused) ipc_reply(cl, "ok 0x%lx", (unsigned long)focused->win);
+        else ipc_reply(cl, "ok none");
+    } else if (strcmp(what, "occupied") == 0) {
+        char buf[4 * MAX_WORKSPACES + 2];
+        int len = 0;
+        buf[0] = '\0';
+        for (int w = 0; w < MAX_WORKSPACES; ++w)
+            if (workspaces[w].count > 0) len += snprintf(buf + len, sizeof(buf) - len, len ? ",%d" : "%d", w + 1);
+        ipc_reply(cl, "ok %s", buf);
+    } else {
+        int ws = argc > 2 ? ipc_workspace(argv[2], 0) : current_workspace;
+        if (ws < 0) { ipc_reply(cl, "err bad workspace"); return; }
+        if (strcmp(what, "layout") == 0) ipc_reply(cl, "ok %s", layouts[workspace_layout[ws]].name);
+        else if (strcmp(what, "mode") == 0) ipc_reply(cl, "ok %s", mode_names[tag_mode[ws]]);
+        else if (strcmp(what, "clients") == 0) ipc_reply(cl, "ok %d", workspaces[ws].count);
+        else if (ipc_tunable(what) >= 0) ipc_reply(cl, "ok %d", workspaces[ws].tune[ipc_tunable(what)]);
+        else ipc_reply(cl, "err unknown query");
+    }
+}
+
+/* stats lists the rows that saw events, stats ROW reads one, stats reset */
+static void ipc_stats(IpcClient *cl, const char *what) {
+    char buf[IPC_LINE_MAX];
+    if (!WM_STATS) { ipc_reply(cl, "err built without WM_STATS"); return; }
+    if (!what) {
+        int len = 0;
+        buf[0] = '\0';
+        for (int i = 0; i < STAT_ROWS && len < (int)sizeof(buf); ++i)
+            if (stat_rows[i].n && stat_names[i])
+                len += snprintf(buf + len, sizeof(buf) - len, len ? ",%s" : "%s", stat_names[i]);
+        ipc_reply(cl, len ? "ok %s" : "ok", buf);
+    } else if (strcmp(what, "reset") == 0) {
+        memset(stat_rows, 0, sizeof(stat_rows));
+        ipc_reply(cl, "ok");
+    } else {
+        int row = stat_find(what);
+        if (row < 0) { ipc_reply(cl, "err unknown row"); return; }
+        stat_format(buf, sizeof(buf), row);
+        ipc_reply(cl, "ok %s", buf);
+    }
+}
+
+static void ipc_command(IpcClient *cl, char *line) {
+    static const char *const dir_names[] = { "left", "down", "up", "right" };
+    char *argv[IPC_MAX_ARGS];
+    int argc = 0;
+    for (char *p = line; *p && argc < IPC_MAX_ARGS; ) {
+        while (*p == ' ' || *p == '\t') *p++ = '\0';
+        if (!*p) break;
+        argv[argc++] = p;
+        while (*p && *p != ' ' && *p != '\t') ++p;
+    }
+    if (!argc) return;
+
+    const char *cmd = argv[0];
+    if (strcmp(cmd, "get") == 0 && argc > 1) {
+        ipc_get(cl, argc, argv);
+    } else if (strcmp(cmd, "stats") == 0 && argc <= 2) {
+        ipc_stats(cl, argc > 1 ? argv[1] : NULL);
+    } else if ((strcmp(cmd, "workspace") == 0 || strcmp(cmd, "send") == 0) && argc == 2) {
+        int ws = ipc_workspace(argv[1], 0);
+        if (ws < 0) { ipc_reply(cl, "err bad workspace"); return; }
+        if (cmd[0] == 'w') switch_workspace(ws);
+        else move_focused_to_workspace(ws);
+        ipc_reply(cl, "ok");
+    } else if (strcmp(cmd, "layout") == 0 && argc == 3) {
+        int ws = ipc_workspace(argv[1], 1);
+        int layout = layout_find(argv[2]);
+        if (ws < 0 || layout < 0) { ipc_reply(cl, "err bad argument"); return; }
+        if (ws == MAX_WORKSPACES) set_layout_for_all(layout);
+        else set_workspace_layout(ws, layout);
+        ipc_reply(cl, "ok");
+    } else if (strcmp(cmd, "mode") == 0 && argc == 3) {
+        static const char *const modes[] = { "floating", "tiling", "toggle" };
+        int ws = ipc_workspace(argv[1], 1);
+        int mode = ipc_lookup(argv[2], modes, 3);
+        if (ws < 0 || mode < 0) { ipc_reply(cl, "err bad argument"); return; }
+        if (mode == 2) mode = tag_mode[ws == MAX_WORKSPACES ? 0 : ws] == MODE_TILING ? MODE_FLOATING : MODE_TILING;
+        if (ws == MAX_WORKSPACES) set_mode_for_all(mode);
+        else set_workspace_mode(ws, mode);
+        ipc_reply(cl, "ok");
+    } else if (strcmp(cmd, "set") == 0 && argc == 4) {
+        /* set N|all mfact|nmaster|gap_inner|gap_outer V, +V or -V */
+        int ws = ipc_workspace(argv[1], 1);
+        int what = ipc_tunable(argv[2]);
+        char *end;
+        long value = strtol(argv[3], &end, 10);
+        if (ws < 0 || what < 0 || end == argv[3] || *end) { ipc_reply(cl, "err bad argument"); return; }
+        int relative = argv[3][0] == '+' || argv[3][0] == '-';
+        for (int w = ws == MAX_WORKSPACES ? 0 : ws; w < MAX_WORKSPACES; ++w) {
+            set_workspace_tune(w, what, (int)value, relative);
+            if (ws != MAX_WORKSPACES) break;
+        }
+        ipc_reply(cl, "ok");
+    } else if (strcmp(cmd, "ratio") == 0 && argc == 2) {
+        char *end;
+        long delta = strtol(argv[1], &end, 10);
+        if (*end || (argv[1][0] != '+' && argv[1][0] != '-')) { ipc_reply(cl, "err bad argument"); return; }
+        if (resize_focused_split((int)delta)) ipc_reply(cl, "ok");
+        else ipc_reply(cl, "err nothing to resize");
+    } else if (strcmp(cmd, "swap") == 0 && argc == 2) {
+        int dir = ipc_lookup(argv[1], dir_names, 4);
+        if (dir < 0) { ipc_reply(cl, "err bad direction"); return; }
+        if (!focused) { ipc_reply(cl, "err no focused window"); return; }
+        Client *cand = find_neighbor_in_direction(focused, dir);
+        if (cand && cand->workspace == current_workspace && !cand->is_dock)
+            swap_clients_keep_focus(focused, cand);
+        ipc_reply(cl, "ok");
+    } else if (strcmp(cmd, "fullscreen") == 0 && argc == 1) {
+        if (!focused) { ipc_reply(cl, "err no focused window"); return; }
+        toggle_fullscreen(focused);
+        ipc_reply(cl, "ok");
+    } else {
+        ipc_reply(cl, "err unknown command");
+    }
+}
+
+static void ipc_accept(void) {
+    int fd;
+    while ((fd = accept(ipc_fd, NULL, NULL)) >= 0) {
+        if (ipc_nclients == IPC_MAX_CLIENTS || set_nonblocking(fd) < 0) { close(fd); continue; }
+        IpcClient *cl = &ipc_clients[ipc_nclients++];
+        cl->fd = fd;
+        cl->len = 0;
+    }
+}
+
+/* run every complete line the client has sent; closes it on EOF */
+static void ipc_read(IpcClient *cl) {
+    while (cl->fd >= 0) {
+        ssize_t n = read(cl->fd, cl->buf + cl->len, sizeof(cl->buf) - cl->len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (n == 0 || errno != EAGAIN) ipc_close(cl);
+            return;
+        }
+        cl->len += n;
+        char *line = cl->buf, *nl;
+        while (cl->fd >= 0 && (nl = memchr(line, '\n', cl->buf + cl->len - line))) {
+            *nl = '\0';
+            ipc_command(cl, line);
+            line = nl + 1;
+        }
+        if (cl->fd < 0) return;
+        cl->len -= line - cl->buf;
+        memmove(cl->buf, line, cl->len);
+        if (cl->len == sizeof(cl->buf)) {
+            ipc_reply(cl, "err line too long");
+            ipc_close(cl);
+        }
+    }
+}
+
+/* forget clients closed while reading */
+static void ipc_reap(void) {
+    int n = 0;
+    for (int i = 0; i < ipc_nclients; ++i)
+        if (ipc_clients[i].fd >= 0) ipc_clients[n++] = ipc_clients[i];
+    ipc_nclients = n;
+}
+
+/* --- config file ---
+ * ~/.wm/config, one setting per line, '#' starts a comment. anything it
+ * leaves out keeps the compiled-in default:
+ *
+ *   mod super|alt|ctrl|mod3|mod5
+ *   border_width N, border_width_focused N, border_width_unfocused N
+ *   border_color_focused NAME, border_color_unfocused NAME
+ *   terminal CMD, launcher CMD
+ *   layout NAME, mfact N, nmaster N, gap_inner N, gap_outer N
+ *   bind KEYS ACTION [ARG]     e.g. bind mod+shift+b spawn firefox
+ *   unbind KEYS, unbind all
+ *
+ * the file is watched through inotify on ~/.wm. a reload diffs against
+ * what is in effect: new colours redraw borders, new bindings regrab just
+ * those keys, and new layout defaults retune only workspaces still on the
+ * old default (live tuning is kept). nothing changed, nothing is sent.
+ */
+#define CONFIG_SETTLE_MS 50 /* editors write in bursts; reload once it settles */
+
+static char config_path[PATH_MAX];
+static int config_fd = -1; /* inotify on ~/.wm */
+
+static int config_command(Config *cf, int slot, const char *cmd) {
+    if (slot < 0) {
+        if (cf->ncommands >= MAX_COMMANDS) return -1;
+        slot = cf->ncommands;
+    }
+    snprintf(cf->commands[slot], COMMAND_MAX, "%s", cmd);
+    if (slot >= cf->ncommands) cf->ncommands = slot + 1;
+    return slot;
+}
+
+static int find_bind(const Config *cf, KeySym sym, unsigned int mods) {
+    for (int i = 0; i < cf->nbinds; ++i)
+        if (cf->binds[i].sym == sym && cf->binds[i].mods == mods) return i;
+    return -1;
+}
+
+/* a key already bound is rebound in place */
+static int config_bind(Config *cf, KeySym sym, unsigned int mods, int action, int arg) {
+    int i = find_bind(cf, sym, mods);
+    if (i < 0) {
+        if (cf->nbinds >= MAX_BINDINGS) return -1;
+        i = cf->nbinds++;
+    }
+    cf->binds[i] = (Binding){ sym, mods, (short)action, (short)arg };
+    return 0;
+}
+
+static void config_unbind(Config *cf, KeySym sym, unsigned int mods) {
+    int i = find_bind(cf, sym, mods);
+    if (i >= 0) cf->binds[i] = cf->binds[--cf->nbinds];
+}
+
+static void config_defaults(Config *cf) {
+    memset(cf, 0, sizeof(*cf));
+    snprintf(cf->color_focus, sizeof(cf->color_focus), "%s", BORDER_COLOR_FOCUS);
+    snprintf(cf->color_unfocus, sizeof(cf->color_unfocus), "%s", BORDER_COLOR_UNFOCUS);
+    cf->border_focus = BORDER_PX_FOCUSED;
+    cf->border_unfocus = BORDER_PX_UNFOCUSED;
+    cf->mod = MOD_MAIN;
+    int layout = layout_find(DEFAULT_LAYOUT_NAME);
+    cf->layout = layout < 0 ? LAYOUT_MASTER : layout;
+    cf->tune[TUNE_MFACT] = DEFAULT_MASTER_FACTOR;
+    cf->tune[TUNE_NMASTER] = DEFAULT_NMASTER;
+    cf->tune[TUNE_GAP_INNER] = DEFAULT_GAP_INNER;
+    cf->tune[TUNE_GAP_OUTER] = DEFAULT_GAP_OUTER;
+    config_command(cf, CMD_TERMINAL, TERMINAL_CMD);
+    config_command(cf, CMD_LAUNCHER, LAUNCHER_CMD);
+    for (size_t i = 0; i < sizeof(default_bindings) / sizeof(default_bindings[0]); ++i)
+        cf->binds[cf->nbinds++] = default_bindings[i];
+    for (int k = 0; k < 2; ++k)
+        for (int ws = 0; ws < MAX_WORKSPACES; ++ws) {
+            config_bind(cf, workspace_keys[k][ws], BIND_MOD, ACT_WORKSPACE, ws);
+            config_bind(cf, workspace_keys[k][ws], BIND_MOD | ShiftMask, ACT_SEND, ws);
+        }
+}
+
+static unsigned int parse_modifier(const char *s) {
+    static const struct { const char *name; unsigned int mask; } mods[] = {
+        { "mod", BIND_MOD }, { "shift", ShiftMask }, { "ctrl", ControlMask }, { "control", ControlMask },
+        { "alt", Mod1Mask }, { "mod1", Mod1Mask }, { "mod3", Mod3Mask }, { "super", Mod4Mask },
+        { "mod4", Mod4Mask }, { "mod5", Mod5Mask },
+    };
+    for (size_t i = 0; i < sizeof(mods) / sizeof(mods[0]); ++i)
+        if (strcmp(s, mods[i].name) == 0) return mods[i].mask;
+    return 0;
+}
+
+/* "mod+shift+Return" */
+static int parse_keys(char *spec, KeySym *sym, unsigned int *mods) {
+    *mods = 0;
+    for (char *plus; (plus = strchr(spec, '+')) && plus[1]; spec = plus + 1) {
+        *plus = '\0';
+        unsigned int m = parse_modifier(spec);
+        if (!m) return -1;
+        *mods |= m;
+    }
+    *sym = XStringToKeysym(spec);
+    return *sym == NoSymbol ? -1 : 0;
+}
+
+static int parse_int(const char *s, int *out) {
+    char *end;
+    long v = strtol(s, &end, 10);
+    if (end == s || *end || v < INT_MIN / 2 || v > INT_MAX / 2) return -1;
+    *out = (int)v;
+    return 0;
+}
+
+static int parse_bind(Config *cf, char *keys, char *action, char *arg) {
+    static const char *const dir_names[] = { "left", "down", "up", "right" };
+    KeySym sym;
+    unsigned int mods;
+    if (!keys || !action || parse_keys(keys, &sym, &mods) < 0) return -1;
+
+    int act = -1, value = 0;
+    if (strcmp(action, "terminal") == 0 || strcmp(action, "launcher") == 0) {
+        return config_bind(cf, sym, mods, ACT_SPAWN, action[0] == 't' ? CMD_TERMINAL : CMD_LAUNCHER);
+    }
+    for (int i = 0; i < ACT_COUNT; ++i)
+        if (strcmp(action, action_names[i]) == 0) act = i;
+    switch (act) {
+    case ACT_SPAWN:
+        if (!arg || (value = config_command(cf, -1, arg)) < 0) return -1;
+        break;
+    case ACT_WORKSPACE:
+    case ACT_SEND:
+        if (!arg || parse_int(arg, &value) < 0 || value < 1 || value > MAX_WORKSPACES) return -1;
+        --value;
+        break;
+    case ACT_FOCUS:
+    case ACT_SWAP:
+        value = -1;
+        for (int i = 0; arg && i < 4; ++i)
+            if (strcmp(arg, dir_names[i]) == 0) value = i;
+        if (value < 0) return -1;
+        break;
+    case ACT_MODE:
+        value = arg && strcmp(arg, "all") == 0;
+        break;
+    case ACT_CYCLE:
+    case ACT_LAYOUT:
+        value = 1;
+        if (arg && strcmp(arg, "prev") == 0) value = -1;
+        else if (arg && strcmp(arg, "next") != 0) return -1;
+        break;
+    case ACT_SPLIT:
+    case ACT_GAP:
+    case ACT_NMASTER:
+        if (!arg || parse_int(arg, &value) < 0) return -1;
+        break;
+    case ACT_CLOSE:
+    case ACT_FULLSCREEN:
+    case ACT_QUIT:
+        break;
+    default:
+        return -1;
+    }
+    return config_bind(cf, sym, mods, act, value);
+}
+
+static int parse_config_line(Config *cf, char *line) {
+    char *hash = strchr(line, '#');
+    if (hash) *hash = '\0';
+    char *key = strtok(line, " \t\r\n");
+    if (!key) return 0;
+    char *val = strtok(NULL, "\r\n");
+    while (val && (*val == ' ' || *val == '\t')) ++val;
+    if (val) for (char *e = val + strlen(val); e > val && (e[-1] == ' ' || e[-1] == '\t'); ) *--e = '\0';
+    if (!val || !*val) return -1;
+
+    int n;
+    if (strcmp(key, "mod") == 0) {
+        /* only the documented ones: with shift every mod binding would
+         * collide with its mod+shift twin in the key table */
+        static const struct { const char *name; unsigned int mask; } mods[] = {
+            { "super", Mod4Mask }, { "alt", Mod1Mask }, { "ctrl", ControlMask },
+            { "mod3", Mod3Mask }, { "mod5", Mod5Mask },
+        };
+        unsigned int m = 0;
+        for (size_t i = 0; i < sizeof(mods) / sizeof(mods[0]); ++i)
+            if (strcmp(val, mods[i].name) == 0) m = mods[i].mask;
+        if (!m) return -1;
+        cf->mod = m;
+    } else if (strncmp(key, "border_width", 12) == 0) {
+        if (parse_int(val, &n) < 0 || n < 0 || n > 100) return -1;
+        if (strcmp(key + 12, "") == 0 || strcmp(key + 12, "_focused") == 0) cf->border_focus = (unsigned int)n;
+        if (strcmp(key + 12, "") == 0 || strcmp(key + 12, "_unfocused") == 0) cf->border_unfocus = (unsigned int)n;
+    } else if (strcmp(key, "border_color_focused") == 0) {
+        snprintf(cf->color_focus, sizeof(cf->color_focus), "%s", val);
+    } else if (strcmp(key, "border_color_unfocused") == 0) {
+        snprintf(cf->color_unfocus, sizeof(cf->color_unfocus), "%s", val);
+    } else if (strcmp(key, "terminal") == 0 || strcmp(key, "launcher") == 0) {
+        config_command(cf, key[0] == 't' ? CMD_TERMINAL : CMD_LAUNCHER, val);
+    } else if (strcmp(key, "layout") == 0) {
+        if ((n = layout_find(val)) < 0) return -1;
+        cf->layout = n;
+    } else if (ipc_tunable(key) >= 0) {
+        int t = ipc_tunable(key);
+        if (parse_int(val, &n) < 0 || n < tunables[t].min || n > tunables[t].max) return -1;
+        cf->tune[t] = n;
+    } else if (strcmp(key, "bind") == 0) {
+        char *keys = strtok(val, " \t");
+        char *action = strtok(NULL, " \t");
+        char *arg = strtok(NULL, "");
+        while (arg && (*arg == ' ' || *arg == '\t')) ++arg;
+        return parse_bind(cf, keys, action, arg && *arg ? arg : NULL);
+    } else if (strcmp(key, "unbind") == 0) {
+        KeySym sym;
+        unsigned int mods;
+        if (strcmp(val, "all") == 0) cf->nbinds = 0;
+        else if (parse_keys(val, &sym, &mods) < 0) return -1;
+        else config_unbind(cf, sym, mods);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/* defaults, then whatever the file says; bad lines are reported and skipped */
+static void load_config(Config *cf) {
+    config_defaults(cf);
+    FILE *f = config_path[0] ? fopen(config_path, "r") : NULL;
+    if (!f) return;
+    char line[COMMAND_MAX + 64];
+    for (int lineno = 1; fgets(line, sizeof(line), f); ++lineno)
+        if (parse_config_line(cf, line) < 0) fprintf(stderr, "%s:%d: ignored\n", config_path, lineno);
+    fclose(f);
+}
+
+/* move from config to next, sending only what differs */
+static void apply_config(const Config *next) {
+    int redraw = 0, rewidth = 0;
+    if (strcmp(config.color_focus, next->color_focus) != 0) {
+        border_focus_col = alloc_color(next->color_focus);
+        redraw = 1;
+    }
+    if (strcmp(config.color_unfocus, next->color_unfocus) != 0) {
+        border_unfocus_col = alloc_color(next->color_unfocus);
+        redraw = 1;
+    }
+    if (config.border_focus != next->border_focus || config.border_unfocus != next->border_unfocus) {
+        border_focus_width = next->border_focus;
+        border_unfocus_width = next->border_unfocus;
+        redraw = rewidth = 1;
+    }
+    /* set_border() skips windows that already look right */
+    if (redraw)
+        for (Client *c = clients; c; c = c->next) draw_border(c);
+    /* tiles are sized with the border taken off */
+    if (rewidth)
+        for (int ws = 0; ws < MAX_WORKSPACES; ++ws)
+            if (tag_mode[ws] == MODE_TILING) queue_arrange(ws);
+
+    if (config.mod != next->mod) {
+        if (config.mod) grab_buttons(config.mod, 0);
+        grab_buttons(next->mod, 1);
+    }
+    update_key_table(next);
+
+    /* workspaces nobody retuned follow the new defaults */
+    for (int t = 0; t < TUNE_COUNT; ++t)
+        if (config.tune[t] != next->tune[t])
+            for (int ws = 0; ws < MAX_WORKSPACES; ++ws)
+                if (workspaces[ws].tune[t] == config.tune[t]) set_workspace_tune(ws, t, next->tune[t], 0);
+    if (config.layout != next->layout)
+        for (int ws = 0; ws < MAX_WORKSPACES; ++ws)
+            if (workspace_layout[ws] == config.layout) set_workspace_layout(ws, next->layout);
+
+    config = *next;
+}
+
+static void reload_config(void) {
+    static Config next;
+    load_config(&next);
+    apply_config(&next);
+}
+
+static void init_config(void) {
+    const char *home = getenv("HOME");
+    if (home) {
+        snprintf(config_path, sizeof(config_path), "%s/.wm/config", home);
+        /* watch the directory: editors often replace the file rather than write it */
+        config_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        char dir[PATH_MAX];
+        snprintf(dir, sizeof(dir), "%s/.wm", home);
+        if (config_fd >= 0 && inotify_add_watch(config_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) < 0) {
+            close(config_fd);
+            config_fd = -1;
+        }
+    }
+    reload_config();
+}
+
+static void handle_config_events(void) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    int touched = 0;
+    while ((len = read(config_fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len; ) {
+            struct inotify_event *ie = (struct inotify_event *)p;
+            if (ie->len && strcmp(ie->name, "config") == 0) touched = 1;
+            p += sizeof(*ie) + ie->len;
+        }
     }
+    if (touched) timer_at(TIMER_CONFIG, now_ms() + CONFIG_SETTLE_MS);
 }
 
 /* --- autolaunch / scan / loop --- */
+/* in a freshly forked child: drop our X connection and give back the
+ * signals the main loop keeps blocked for its signalfd */
+static void child_prepare(void) {
+    if (dpy) close(ConnectionNumber(dpy));
+    setsid();
+    sigprocmask(SIG_SETMASK, &child_sigmask, NULL);
+}
+
 static void run_autolaunch(void) {
     const char *home = getenv("HOME");
     if (!home) return;
@@ -1585,46 +3715,145 @@ static void run_autolaunch(void) {
     if (access(path, F_OK) == 0) {
         pid_t pid = fork();
         if (pid == 0) {
-            if (dpy) close(ConnectionNumber(dpy));
-            setsid();
+            child_prepare();
             execl(path, path, (char*)NULL);
             _exit(EXIT_FAILURE);
         }
     }
 }
 
+/* adopt every child of root. all queries go out before any reply is read,
+ * so startup costs the same two round trips however many windows exist;
+ * focus, layout and status are left queued for the caller's flush. */
 static void scan_existing_windows(void) {
     Window root_ret, parent;
     Window *children = NULL;
     unsigned int nchildren = 0;
-    if (XQueryTree(dpy, root, &root_ret, &parent, &children, &nchildren)) {
-        for (unsigned int i = 0; i < nchildren; ++i) {
-            Window w = children[i];
-            XWindowAttributes wa;
-            if (XGetWindowAttributes(dpy, w, &wa)) manage(w);
-        }
-        if (children) XFree(children);
+    int ok = XQueryTree(dpy, root, &root_ret, &parent, &children, &nchildren);
+    stat_sync();
+    if (!ok) return;
+
+    WindowQuery *q = nchildren ? malloc(nchildren * sizeof(WindowQuery)) : NULL;
+    if (q) {
+        for (unsigned int i = 0; i < nchildren; ++i) query_window(children[i], &q[i]);
+        /* manage_queried() skips windows that have gone away meanwhile */
+        for (unsigned int i = 0; i < nchildren; ++i) manage_queried(children[i], &q[i]);
+        free(q);
+    } else {
+        for (unsigned int i = 0; i < nchildren; ++i) manage(children[i]);
     }
+    if (children) XFree(children);
 }
 
-static void run_loop(void) {
+static void handle_event(XEvent *ev) {
+    switch (ev->type) {
+        case MapRequest:       handle_maprequest(ev); break;
+        case DestroyNotify:    handle_destroynotify(ev); break;
+        case UnmapNotify:      handle_unmapnotify(ev); break;
+        case CreateNotify:     handle_createnotify(ev); break;
+        case ReparentNotify:   handle_reparentnotify(ev); break;
+        case ConfigureRequest: handle_configurerequest(ev); break;
+        case EnterNotify:      handle_enternotify(ev); break;
+        case MotionNotify:     handle_motionnotify(ev); break;
+        case ButtonPress:      handle_buttonpress(ev); break;
+        case KeyPress:         handle_keypress(ev); break;
+        case KeyRelease:       handle_keyrelease(ev); break;
+        case MappingNotify:    handle_mappingnotify(ev); break;
+        case ClientMessage:    handle_clientmessage(ev); break;
+        case PropertyNotify:   handle_propertynotify(ev); break;
+        case ConfigureNotify:  if (ev->xconfigure.window == root) handle_screen_change(ev); break;
+        default:
+            if (have_sync && ev->type == sync_event_base + XSyncAlarmNotify) handle_sync_alarm(ev);
+#ifdef XRANDR
+            else if (have_randr && ev->type == randr_event_base + RRScreenChangeNotify) handle_screen_change(ev);
+#endif
+            break;
+    }
+}
+
+/* handle everything already queued, then run what is due and send the
+ * merged requests in one go */
+static void process_events(void) {
     XEvent ev;
-    while (1) {
+    StatMark m;
+    while (XEventsQueued(dpy, QueuedAfterReading)) {
         XNextEvent(dpy, &ev);
-        switch (ev.type) {
-            case MapRequest:       handle_maprequest(&ev); break;
-            case DestroyNotify:    handle_destroynotify(&ev); break;
-            case UnmapNotify:      handle_unmapnotify(&ev); break;
-            case ConfigureRequest: handle_configurerequest(&ev); break;
-            case EnterNotify:      handle_enternotify(&ev); break;
-            case MotionNotify:     handle_motionnotify(&ev); break;
-            case ButtonPress:      handle_buttonpress(&ev); break;
-            case KeyPress:         handle_keypress(&ev); break;
-            case KeyRelease:       handle_keyrelease(&ev); break;
-            case ClientMessage:    handle_clientmessage(&ev); break;
-            case PropertyNotify:   handle_propertynotify(&ev); break;
-            default:               break;
+        stat_begin(&m);
+        handle_event(&ev);
+        stat_end(ev.type < LASTEvent ? ev.type : STAT_EXTENSION, &m);
+    }
+    stat_begin(&m);
+    timers_run();
+    stat_end(STAT_TIMERS, &m);
+    stat_begin(&m);
+    flush_pending();
+    stat_end(STAT_FLUSH, &m);
+    timers_arm();
+}
+
+/* signals and timers reach run_loop() as fds, so no handler ever
+ * interrupts the wm mid-update */
+static void setup_loop(void) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (WM_STATS) sigaddset(&mask, SIGUSR1);
+    if (sigprocmask(SIG_BLOCK, &mask, &child_sigmask) < 0) die("sigprocmask failed");
+    signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd < 0) die("signalfd failed");
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0) die("timerfd failed");
+}
+
+static void handle_signals(void) {
+    struct signalfd_siginfo si;
+    while (read(signal_fd, &si, sizeof(si)) == (ssize_t)sizeof(si)) {
+        if (si.ssi_signo == SIGCHLD)
+            while (waitpid(-1, NULL, WNOHANG) > 0);
+        else if (si.ssi_signo == SIGUSR1)
+            stats_dump(stderr);
+    }
+}
+
+static void run_loop(void) {
+    enum { LOOP_X, LOOP_TIMER, LOOP_SIGNAL, LOOP_IPC, LOOP_CONFIG, LOOP_FDS };
+    struct pollfd fds[LOOP_FDS + IPC_MAX_CLIENTS];
+    while (1) {
+        fds[LOOP_X]      = (struct pollfd){ .fd = ConnectionNumber(dpy), .events = POLLIN };
+        fds[LOOP_TIMER]  = (struct pollfd){ .fd = timer_fd, .events = POLLIN };
+        fds[LOOP_SIGNAL] = (struct pollfd){ .fd = signal_fd, .events = POLLIN };
+        fds[LOOP_IPC]    = (struct pollfd){ .fd = ipc_fd, .events = POLLIN };
+        fds[LOOP_CONFIG] = (struct pollfd){ .fd = config_fd, .events = POLLIN };
+        int nfds = LOOP_FDS, nipc = ipc_nclients;
+        for (int i = 0; i < nipc; ++i)
+            fds[nfds++] = (struct pollfd){ .fd = ipc_clients[i].fd, .events = POLLIN };
+
+        /* XPending flushes; with events already buffered the poll only
+         * checks, so a steady X stream cannot starve the other fds */
+        if (poll(fds, nfds, XPending(dpy) ? 0 : -1) < 0 && errno != EINTR)
+            die("poll failed");
+        if (fds[LOOP_TIMER].revents & POLLIN) {
+            uint64_t expirations;
+            ssize_t r = read(timer_fd, &expirations, sizeof(expirations));
+            (void)r;
+            timer_armed = 0; /* a fired one-shot timer is disarmed */
+        }
+        if (fds[LOOP_SIGNAL].revents & POLLIN) handle_signals();
+        /* control commands queue work like keys do; it goes out below */
+        StatMark m;
+        int ipc_busy = 0;
+        stat_begin(&m);
+        for (int i = 0; i < nipc; ++i)
+            if (fds[LOOP_FDS + i].revents) { ipc_read(&ipc_clients[i]); ipc_busy = 1; }
+        ipc_reap();
+        if (fds[LOOP_IPC].revents & POLLIN) { ipc_accept(); ipc_busy = 1; }
+        if (ipc_busy) stat_end(STAT_IPC, &m);
+        if (fds[LOOP_CONFIG].revents & POLLIN) {
+            stat_begin(&m);
+            handle_config_events();
+            stat_end(STAT_CONFIG, &m);
         }
+        process_events();
     }
 }
 
@@ -1632,8 +3861,7 @@ static void run_loop(void) {
 static void spawn_program(char *const argv[]) {
     pid_t pid = fork();
     if (pid == 0) {
-        if (dpy) close(ConnectionNumber(dpy));
-        setsid();
+        child_prepare();
         execvp(argv[0], argv);
         _exit(EXIT_FAILURE);
     } else if (pid < 0) {
@@ -1655,32 +3883,26 @@ static void send_wm_delete(Window w) {
 
 static void toggle_fullscreen(Client *c) {
     if (!c) return;
-    int rw = DisplayWidth(dpy, screen_num);
-    int rh = DisplayHeight(dpy, screen_num);
-    if (c->x == 0 && c->y == 0 && (int)c->w == rw && (int)c->h == rh) {
+    const Output *o = ws_out(c->workspace);
+    int rw = o->w;
+    int rh = o->h;
+    if (c->x == o->x && c->y == o->y && (int)c->w == rw && (int)c->h == rh) {
         int nw = rw * 2 / 3;
         int nh = rh * 2 / 3;
-        int nx = (rw - nw) / 2;
-        int ny = (rh - nh) / 2;
+        int nx = o->x + (rw - nw) / 2;
+        int ny = o->y + (rh - nh) / 2;
         c->x = nx; c->y = ny; c->w = nw; c->h = nh;
-        XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
+        configure_client(c);
     } else {
-        c->x = 0; c->y = 0; c->w = rw; c->h = rh;
-        XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
+        c->x = o->x; c->y = o->y; c->w = rw; c->h = rh;
+        configure_client(c);
     }
 }
 
 /* --- startup --- */
-int main(void) {
-    struct sigaction sa;
-    sa.sa_handler = sigchld_handler;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
-    sigaction(SIGCHLD, &sa, NULL);
-
-    dpy = XOpenDisplay(NULL);
-    if (!dpy) die("cannot open display");
+static void setup(void) {
     XSetErrorHandler(xerror_handler);
+    xc = XGetXCBConnection(dpy);
 
     screen_num = DefaultScreen(dpy);
     root = RootWindow(dpy, screen_num);
@@ -1694,39 +3916,59 @@ int main(void) {
     NET_WM_STRUT_PARTIAL    = XInternAtom(dpy, "_NET_WM_STRUT_PARTIAL", False);
     NET_WM_STATE            = XInternAtom(dpy, "_NET_WM_STATE", False);
     NET_WM_STATE_ABOVE      = XInternAtom(dpy, "_NET_WM_STATE_ABOVE", False);
-
-    border_focus_col   = alloc_color(BORDER_COLOR_FOCUS);
-    border_unfocus_col = alloc_color(BORDER_COLOR_UNFOCUS);
-    border_focus_width = BORDER_PX_FOCUSED;
-    border_unfocus_width = BORDER_PX_UNFOCUSED;
+    NET_WORKAREA            = XInternAtom(dpy, "_NET_WORKAREA", False);
+    NET_WM_SYNC_REQUEST         = XInternAtom(dpy, "_NET_WM_SYNC_REQUEST", False);
+    NET_WM_SYNC_REQUEST_COUNTER = XInternAtom(dpy, "_NET_WM_SYNC_REQUEST_COUNTER", False);
+
+    int sync_error_base, sync_major, sync_minor;
+    have_sync = XSyncQueryExtension(dpy, &sync_event_base, &sync_error_base) &&
+                XSyncInitialize(dpy, &sync_major, &sync_minor);
+
+    cursor_move   = XCreateFontCursor(dpy, MOVE_CURSOR);
+    cursor_resize = XCreateFontCursor(dpy, RESIZE_CURSOR);
+    if (DRAG_OUTLINE) {
+        XGCValues gv;
+        gv.function = GXinvert;
+        gv.subwindow_mode = IncludeInferiors;
+        gv.line_width = 2;
+        outline_gc = XCreateGC(dpy, root, GCFunction | GCSubwindowMode | GCLineWidth, &gv);
+    }
 
     for (int i = 0; i < MAX_WORKSPACES; ++i) tag_mode[i] = (DEFAULT_TAG_MODE ? MODE_TILING : MODE_FLOATING);
 
-    /* init workspace layout from DEFAULT_LAYOUT_NAME */
-    for (int i = 0; i < MAX_WORKSPACES; ++i) {
-        if (strcmp(DEFAULT_LAYOUT_NAME, "dwindle") == 0) workspace_layout[i] = LAYOUT_DWINDLE;
-        else workspace_layout[i] = LAYOUT_MASTER;
-    }
-
     if (XSelectInput(dpy, root,
-                     SubstructureRedirectMask | SubstructureNotifyMask |
+                     SubstructureRedirectMask | SubstructureNotifyMask | StructureNotifyMask |
                      ButtonPressMask | EnterWindowMask | PointerMotionMask | KeyReleaseMask) == BadAccess) {
         die("another window manager is running");
     }
 
-    grab_keys_and_buttons();
+    init_outputs();
+
+    init_state_export();
+    init_ipc();
+    /* workspaces start zeroed, like the config in effect, so the first
+     * apply moves all of them onto the defaults and grabs every key */
+    init_config();
+}
+
+int main(void) {
+    setup_loop();
+
+    dpy = XOpenDisplay(NULL);
+    if (!dpy) die("cannot open display");
+
+    setup();
 
     run_autolaunch();
 
     scan_existing_windows();
 
-    /* compute reserved areas from any existing bars */
-    update_global_struts();
-
-    for (int i = 0; i < MAX_WORKSPACES; ++i) if (tag_mode[i] == MODE_TILING) tile_workspace(i);
+    /* lay out once with the struts of every adopted bar; hidden workspaces
+     * are only marked dirty until shown */
+    for (int i = 0; i < MAX_WORKSPACES; ++i) queue_arrange(i);
 
-    write_focused_workspace_file(current_workspace);
-    write_occupied_workspace_file();
+    queue_status();
+    flush_pending();
 
     run_loop();
 